@@ -0,0 +1,69 @@
+# A stand-in DNS server for user/dnstest, run on the QEMU host.
+#
+# Inside QEMU, the host is 10.0.2.2, and lwIP always queries
+# port 53, so this needs to be allowed to bind it:
+#
+#   sudo python3 dnsserver.py
+#
+# It answers A queries for:
+#   xv6.test      10.9.8.7, TTL 60
+#   hostN.test    10.9.8.N, TTL 60
+#   countN.test   10.0.0.K, TTL 60, where K is the number of
+#                 queries for nx.test seen so far
+# and NXDOMAIN for everything else.
+
+import socket
+import struct
+import sys
+
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 53
+
+queries = {}
+
+def parse_name(msg, off):
+    labels = []
+    while msg[off] != 0:
+        n = msg[off]
+        labels.append(msg[off+1:off+1+n].decode())
+        off += 1 + n
+    return ".".join(labels).lower(), off + 1
+
+def lookup(name):
+    if name == "xv6.test":
+        return "10.9.8.7"
+    if name.startswith("host") and name.endswith(".test"):
+        n = name[4:-5]
+        if n.isdigit() and int(n) < 256:
+            return "10.9.8." + n
+    if name.startswith("count") and name.endswith(".test"):
+        return "10.0.0.%d" % min(queries.get("nx.test", 0), 255)
+    return None
+
+def answer(msg):
+    qid, flags, qdcount = struct.unpack("!HHH", msg[:6])
+    name, end = parse_name(msg, 12)
+    question = msg[12:end+4]
+    queries[name] = queries.get(name, 0) + 1
+    addr = lookup(name)
+    print("query %s -> %s" % (name, addr or "NXDOMAIN"))
+    rd = flags & 0x0100
+    if addr is None:
+        hdr = struct.pack("!HHHHHH", qid, 0x8003 | rd, 1, 0, 0, 0)
+        return hdr + question
+    hdr = struct.pack("!HHHHHH", qid, 0x8000 | rd, 1, 1, 0, 0)
+    rr = struct.pack("!HHHIH", 0xc00c, 1, 1, 60, 4) + socket.inet_aton(addr)
+    return hdr + question + rr
+
+def main():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(("", PORT))
+    print("DNS stand-in listening on port %d..." % PORT)
+    while True:
+        msg, peer = s.recvfrom(512)
+        try:
+            s.sendto(answer(msg), peer)
+        except (IndexError, struct.error):
+            print("malformed query from %s" % (peer,))
+
+if __name__ == "__main__":
+    main()
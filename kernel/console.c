@@ -27,22 +27,28 @@
 
 //
 // send one character to the uart.
+// called by printf() and to echo input characters, but
+// not from write(). queues the character without sleeping;
+// while panicking, writes it out synchronously instead.
 //
 void
 consputc(int c)
 {
   extern volatile int panicked; // from printf.c
+  extern volatile int panicking;
+  void (*putc)(int);
 
   if(panicked){
     for(;;)
       ;
   }
 
+  putc = panicking ? uartputc_sync : uartputc;
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc('\b'); uartputc(' '); uartputc('\b');
+    putc('\b'); putc(' '); putc('\b');
   } else {
-    uartputc(c);
+    putc(c);
   }
 }
 
@@ -63,16 +69,17 @@ struct {
 int
 consolewrite(struct file *f, int user_src, uint64 src, int n)
 {
-  int i;
-
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    consputc(c);
+    uartwrite(buf, m);
   }
-  release(&cons.lock);
 
   return i;
 }
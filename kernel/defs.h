@@ -9,9 +9,17 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct socket;
+struct dnsreq;
 struct sockaddr;
 struct tcp_pcb;
 struct pollfd;
+struct netstat;
+struct vmspace;
+struct text;
+struct iperfreport;
+struct elfhdr;
+struct virtq;
+struct virtq_seg;
 
 // bio.c
 void            binit(void);
@@ -32,6 +40,7 @@ int             exec(char*, char**);
 // file.c
 int             fdalloc(struct file*);
 int             fdalloc_for_proc(struct file*, struct proc*);
+struct file*    fdget(struct proc*, int);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
@@ -65,6 +74,12 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, uint, int);
+int             futexwake(uint64, int);
+void            futextick(void);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
@@ -79,23 +94,36 @@ void            end_op(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+struct pipe*    pipecreate(void);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipeconsume(struct pipe*, int, int, int (*)(void*, char*, int), void*);
+int             pipeeof(struct pipe*);
+int             pipereadable(struct pipe*);
+int             pipewritable(struct pipe*);
+int             pipegetsize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
 
 // socket.c
 void            sockinit(void);
-int             sockalloc(int, int, int, struct tcp_pcb*, struct proc*);
+int             sockalloc(int, int, int, struct tcp_pcb*, struct proc*, struct socket**);
 void            sockclose(struct socket*);
 int             sockread(struct socket*, uint64, int, char);
 int             sockwrite(struct socket*, uint64, int, char);
-int             sockconnect(int, const struct sockaddr*, int);
-int             sockbind(int, const struct sockaddr*, int);
-int             socklisten(int, int);
-int             sockaccept(int, struct sockaddr*, int*, char);
+int             socksplice(struct socket*, struct pipe*, int);
+int             sockrecvfrom(struct socket*, uint64, int, struct sockaddr*, char);
+int             socksendto(struct socket*, uint64, int, const struct sockaddr*);
+int             sockconnect(struct socket*, const struct sockaddr*, int);
+int             sockbind(struct socket*, const struct sockaddr*, int);
+int             socklisten(struct socket*, int);
+int             sockaccept(struct socket*, struct sockaddr*, int*, char);
 int             sockgethostbyname(const char*, struct sockaddr*);
 int             sockinetaddress(const char*, struct sockaddr*);
 int             sockpoll(struct pollfd*, int, int);
 void            sock_poll_wakeup(void);
+void            sock_poll_tick(void);
+void            socknetstat(struct netstat*);
+int             socklat(uint64, int);
 
 // printf.c
 void            backtrace(void);
@@ -107,9 +135,11 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             clone(uint64, uint64, uint64);
+uint64          growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, uint64);
+int             vmreplace(struct proc*, pagetable_t, uint64, struct text*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -121,11 +151,24 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeuplocal(void*);
+int             wakeupn(void*, int);
 void            yield(void);
+int             setaffinity(int, uint);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 
+// prof.c
+void            profinit(void);
+int             proftick(void);
+void            profsample(int, uint64, uint64);
+int             profctl(int);
+int             profread(uint64, int);
+
+// start.c
+void            timerinterval(uint64);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -138,6 +181,24 @@ void            push_off(void);
 void            pop_off(void);
 uint64          sys_ntas(void);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+uint64          shmat(int);
+int             shmdt(uint64);
+int             shmfork(struct vmspace*, struct vmspace*);
+void            shmdetachall(struct vmspace*);
+
+// text.c
+void            textinit(void);
+struct text*    textget(struct inode*, struct elfhdr*);
+struct text*    textdup(struct text*);
+void            textput(struct text*);
+void            textinval(struct inode*);
+int             textreclaim(void);
+uint64          textsize(struct text*);
+char*           textpage(struct text*, uint64);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -174,6 +235,8 @@ void            usertrapret(void);
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartputc_sync(int);
+void            uartwrite(char*, int);
 int             uartgetc(void);
 
 // vm.c
@@ -189,6 +252,8 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmfault(uint64, int);
+int             uvmprivate(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -200,6 +265,14 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// virtio.c
+uint64          virtio_features(uint64, uint32);
+void            virtq_init(struct virtq*, uint64, int, int, uint64);
+int             virtq_put(struct virtq*, struct virtq_seg*, int, void*);
+void            virtq_notify(struct virtq*);
+void*           virtq_peek(struct virtq*, int, uint32*);
+void*           virtq_get(struct virtq*, uint32*);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
@@ -230,12 +303,42 @@ int lst_empty(struct list*);
 
 // extra files for lab net
 
+// unixsock.c
+void            unixinit(void);
+int             unixbind(struct socket*, char*);
+int             unixlisten(struct socket*);
+int             unixconnect(struct socket*, char*);
+int             unixaccept(struct socket*, struct sockaddr*, int*, char);
+int             unixread(struct socket*, uint64, int, char);
+int             unixwrite(struct socket*, uint64, int, char);
+short           unixpoll(struct socket*, short);
+void            unixclose(struct socket*);
+
+// resolv.c
+void            resolvinit(void);
+void            resolvserver(uint32);
+struct dnsreq*  dnsstart(char*);
+int             dnswait(struct dnsreq*, int, uint32*);
+int             dnsready(struct dnsreq*);
+int             dnsread(struct dnsreq*, uint64, int, int);
+void            dnsclose(struct dnsreq*);
+
+// iperf.c
+int             iperf(int, uint32, int, struct iperfreport*);
+
 // net.c
 void            netinit(void);
+int             netwait(uint32);
 int             nettimer(void);
+int             netstat(uint64);
+uint64          netrxtime(void);
+unsigned long   r_mtime(void);
 
 // virtio_net.c
-void            virtio_net_init(void *);
+int             virtio_net_init(void *, int);
 int             virtio_net_send(const void *data, int len);
-int             virtio_net_recv(void *data, int len);
-void            virtio_net_intr(void);
\ No newline at end of file
+int             virtio_net_rxcopy(void *data, int off, int len);
+void            virtio_net_rxdone(void);
+int             virtio_net_rxlen(void);
+void            virtio_net_intr(void);
+void            virtio_net_stats(struct netstat*);
\ No newline at end of file
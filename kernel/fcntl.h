@@ -8,6 +8,8 @@
 // fcntl commands
 #define F_GETFL   3
 #define F_SETFL   4
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
 
 // Error codes for non-blocking operations
 #define EAGAIN    11
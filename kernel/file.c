@@ -81,6 +81,8 @@ fileclose(struct file *f)
     end_op();
   } else if(ff.type == FD_SOCK){
     sockclose(ff.sock);
+  } else if(ff.type == FD_DNS){
+    dnsclose(ff.dns);
   }
 }
 
@@ -114,7 +116,7 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblocking);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
@@ -126,6 +128,8 @@ fileread(struct file *f, uint64 addr, int n)
     iunlock(f->ip);
   } else if(f->type == FD_SOCK){
     r = sockread(f->sock, addr, n, f->nonblocking);
+  } else if(f->type == FD_DNS){
+    r = dnsread(f->dns, addr, n, f->nonblocking);
   }
   else {
     panic("fileread");
@@ -145,7 +149,7 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblocking);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
@@ -1,5 +1,5 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCK } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCK, FD_DNS } type;
   int ref; // reference count
   char readable;
   char writable;
@@ -7,6 +7,7 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   struct socket *sock; // FD_SOCK
+  struct dnsreq *dns; // FD_DNS
   uint off;          // FD_INODE and FD_DEVICE
   short major;       // FD_DEVICE
   short minor;       // FD_DEVICE
@@ -0,0 +1,150 @@
+// Futexes: blocking on a 32-bit word of user memory.
+//
+// futexwait() sleeps until futexwake() is called on the same
+// word, as long as the word still holds the expected value.
+// Waiters sleep in the ordinary hashed wait queues (see
+// sleep() in proc.c), on a channel equal to the physical
+// address of the word, so threads and processes that map the
+// same page find each other. A per-hash-bucket lock makes the
+// value check and going to sleep atomic with respect to wakes.
+//
+// Waiters with a timeout are also listed in futextimers, and
+// the clock interrupt wakes their channel once it expires.
+// Wakeups may be spurious; callers recheck the word.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXLOCK 64
+#define FUTEX_HASH(pa) (((pa) >> 2) % NFUTEXLOCK)
+
+static struct spinlock futexlock[NFUTEXLOCK];
+
+// a timed waiter, on its kernel stack.
+struct futextimer {
+  void *chan;
+  uint deadline;               // value of ticks when it expires
+  struct futextimer *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct futextimer *head;
+} futextimers;
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXLOCK; i++)
+    initlock(&futexlock[i], "futex");
+  initlock(&futextimers.lock, "futextimers");
+}
+
+// Physical address of the aligned user word at va, or 0.
+static uint64
+futexaddr(uint64 va)
+{
+  uint64 pa;
+
+  if(va % sizeof(uint))
+    return 0;
+  // the word is going to be written, so a shared program image
+  // page must become private first, or waker and waiter could
+  // see different pages.
+  if(uvmfault(va, PTE_W) < 0)
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(va))) == 0)
+    return 0;
+  return pa + (va - PGROUNDDOWN(va));
+}
+
+// Sleep on the user word at addr if it holds val, for at most
+// timeout ticks if timeout > 0. Returns 0 if woken or the word
+// did not hold val, 1 if the timeout expired, -1 on error.
+int
+futexwait(uint64 addr, uint val, int timeout)
+{
+  struct proc *p = myproc();
+  struct futextimer t, **tp;
+  struct spinlock *lk;
+  uint64 pa;
+  int r = 0;
+
+  if((pa = futexaddr(addr)) == 0)
+    return -1;
+
+  lk = &futexlock[FUTEX_HASH(pa)];
+  acquire(lk);
+  if(*(volatile uint*)pa != val){
+    release(lk);
+    return 0;
+  }
+
+  if(timeout > 0){
+    t.chan = (void*)pa;
+    t.deadline = ticks + timeout;
+    acquire(&futextimers.lock);
+    t.next = futextimers.head;
+    futextimers.head = &t;
+    release(&futextimers.lock);
+  }
+
+  sleep((void*)pa, lk);
+  release(lk);
+
+  if(timeout > 0){
+    acquire(&futextimers.lock);
+    for(tp = &futextimers.head; *tp; tp = &(*tp)->next){
+      if(*tp == &t){
+        *tp = t.next;
+        break;
+      }
+    }
+    release(&futextimers.lock);
+    if((int)(ticks - t.deadline) >= 0)
+      r = 1;
+  }
+
+  if(p->killed)
+    return -1;
+  return r;
+}
+
+// Wake at most n processes sleeping on the user word at addr.
+// Returns how many were woken, or -1 on error.
+int
+futexwake(uint64 addr, int n)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int woken;
+
+  if((pa = futexaddr(addr)) == 0)
+    return -1;
+
+  lk = &futexlock[FUTEX_HASH(pa)];
+  acquire(lk);
+  woken = wakeupn((void*)pa, n);
+  release(lk);
+  return woken;
+}
+
+// Called on every clock tick: wake waiters whose timeout
+// has expired. They may not be asleep yet, in which case
+// a later tick tries again.
+void
+futextick(void)
+{
+  struct futextimer *t;
+
+  acquire(&futextimers.lock);
+  for(t = futextimers.head; t; t = t->next)
+    if((int)(ticks - t->deadline) >= 0)
+      wakeup(t->chan);
+  release(&futextimers.lock);
+}
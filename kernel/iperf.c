@@ -0,0 +1,125 @@
+// In-kernel iperf endpoint.
+//
+// iperf() runs one iperf2 TCP test with lwIP's lwiperf app,
+// either waiting for a client to connect (IPERF_SERVER) or
+// sending to a server for ten seconds (IPERF_CLIENT). The data
+// never crosses the socket layer or a system call, so next to
+// a socket benchmark over the same link it shows what the
+// driver and lwIP alone can do. The result is printed on the
+// console and copied back to the caller.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "iperf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/apps/lwiperf.h"
+
+#define NIPERF 4        // tests running at once
+
+enum { IPERF_FREE, IPERF_RUNNING, IPERF_DONE };
+
+struct iperf {
+  int state;
+  void *session;               // lwiperf's handle
+  struct iperfreport r;
+};
+
+extern struct spinlock lwip_lock;
+
+// protected by lwip_lock, which lwiperf runs under.
+static struct iperf iperfs[NIPERF];
+
+static char *reasons[] = {
+[LWIPERF_TCP_ABORTED_LOCAL]           "local error",
+[LWIPERF_TCP_ABORTED_LOCAL_DATAERROR] "bad data",
+[LWIPERF_TCP_ABORTED_LOCAL_TXERROR]   "send error",
+[LWIPERF_TCP_ABORTED_REMOTE]          "peer aborted",
+};
+
+// lwiperf's report function, when a test ends.
+static void
+iperfdone(void *arg, enum lwiperf_report_type type,
+          const ip_addr_t *local_addr, u16_t local_port,
+          const ip_addr_t *remote_addr, u16_t remote_port,
+          u32_t bytes, u32_t ms, u32_t kbps)
+{
+  struct iperf *ip = arg;
+  char addr[IPADDR_STRLEN_MAX];
+
+  ipaddr_ntoa_r(remote_addr, addr, sizeof(addr));
+  if(type == LWIPERF_TCP_DONE_SERVER || type == LWIPERF_TCP_DONE_CLIENT)
+    printf("iperf: %s %s:%d %d bytes in %d ms, %d kbit/s\n",
+           type == LWIPERF_TCP_DONE_SERVER ? "from" : "to",
+           addr, remote_port, bytes, ms, kbps);
+  else
+    printf("iperf: %s:%d aborted, %s, after %d bytes\n",
+           addr, remote_port, reasons[type], bytes);
+
+  if(ip->state != IPERF_RUNNING)
+    return;
+  ip->r.aborted = type != LWIPERF_TCP_DONE_SERVER && type != LWIPERF_TCP_DONE_CLIENT;
+  ip->r.remote = ip_2_ip4(remote_addr)->addr;
+  ip->r.remoteport = remote_port;
+  ip->r.bytes = bytes;
+  ip->r.ms = ms;
+  ip->r.kbps = kbps;
+  ip->state = IPERF_DONE;
+  wakeup(ip);
+}
+
+// Run one test: as a server on port, or as a client of
+// addr (network byte order) and port. Fills in *r and
+// returns 0, or returns -1 if the test could not start
+// or the caller was killed.
+int
+iperf(int mode, uint32 addr, int port, struct iperfreport *r)
+{
+  struct proc *p = myproc();
+  ip_addr_t remote = IPADDR4_INIT(addr);
+  struct iperf *ip;
+  int rc = 0;
+
+  if(mode != IPERF_SERVER && mode != IPERF_CLIENT)
+    return -1;
+  if(netwait(addr) < 0)
+    return -1;
+
+  acquire(&lwip_lock);
+  for(ip = iperfs; ip < &iperfs[NIPERF]; ip++)
+    if(ip->state == IPERF_FREE)
+      break;
+  if(ip == &iperfs[NIPERF]){
+    release(&lwip_lock);
+    return -1;
+  }
+  ip->state = IPERF_RUNNING;
+  if(mode == IPERF_SERVER)
+    ip->session = lwiperf_start_tcp_server(IP_ADDR_ANY, port, iperfdone, ip);
+  else
+    ip->session = lwiperf_start_tcp_client(&remote, port, LWIPERF_CLIENT, iperfdone, ip);
+  if(ip->session == 0){
+    ip->state = IPERF_FREE;
+    release(&lwip_lock);
+    return -1;
+  }
+
+  while(ip->state == IPERF_RUNNING && !p->killed)
+    sleep(ip, &lwip_lock);
+
+  if(ip->state == IPERF_RUNNING){
+    lwiperf_abort(ip->session);
+    rc = -1;
+  } else {
+    // a client's session is over; a server's listener is not.
+    if(mode == IPERF_SERVER)
+      lwiperf_abort(ip->session);
+    *r = ip->r;
+  }
+  ip->state = IPERF_FREE;
+  release(&lwip_lock);
+  return rc;
+}
@@ -0,0 +1,15 @@
+// Result of an in-kernel iperf test, returned by iperf().
+
+#define IPERF_SERVER 0     // wait for an iperf2 client to connect
+#define IPERF_CLIENT 1     // send to an iperf2 server for 10 seconds
+
+#define IPERF_PORT 5001    // iperf2's default
+
+struct iperfreport {
+  int aborted;         // 0 if the test ran to the end
+  uint32 remote;       // peer address, in network byte order
+  uint16 remoteport;
+  uint32 bytes;        // bytes transferred
+  uint32 ms;           // duration
+  uint32 kbps;         // bandwidth, kbit/s
+};
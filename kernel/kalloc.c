@@ -31,12 +31,17 @@ kinit()
   freerange(end, (void*)PHYSTOP);
 }
 
+// Free pages from the top down, so the LIFO freelist hands
+// them out in ascending order: consecutive kalloc()s, e.g. for
+// a new process image, then tend to be physically contiguous,
+// which lets copyin/copyout move them in one run.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  char *p, *start;
+  start = (char*)PGROUNDUP((uint64)pa_start);
+  p = (char*)PGROUNDDOWN((uint64)pa_end);
+  for(p -= PGSIZE; p >= start; p -= PGSIZE)
     kfree(p);
 }
 
@@ -67,11 +72,14 @@ kfree(void *pa)
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// Program images cached by exec() but not in use are given
+// back if there is nothing else.
 void *
 kalloc(void)
 {
   struct run *r;
 
+ again:
   acquire(&kmem.lock);
   r = kmem.freelist;
   if(r){
@@ -79,6 +87,8 @@ kalloc(void)
     kmem.nfree--;
   }
   release(&kmem.lock);
+  if(r == 0 && textreclaim())
+    goto again;
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
@@ -0,0 +1,11 @@
+// Per-name spinlock statistics returned by lockstat().
+// Locks sharing a name (e.g. every "proc" lock) are summed.
+// Times are in CLINT mtime ticks (10 MHz under qemu).
+struct lockstat {
+  char name[16];    // Lock name
+  int nlocks;       // Number of locks with this name
+  uint64 nacquire;  // Calls to acquire()
+  uint64 nspin;     // Failed test-and-set attempts while spinning
+  uint64 holdtime;  // Total time held
+  uint64 maxhold;   // Longest single hold
+};
@@ -8,11 +8,34 @@
 #define LWIP_ARP 1
 #define LWIP_DHCP 1
 #define LWIP_DNS 1
+// names cached for their TTL, and lookups in flight at once
+#define DNS_TABLE_SIZE 16
+#define DNS_MAX_REQUESTS 8
 #define LWIP_ETHERNET 1
 
+// largest IP packet on the wire; "make MTU=..." sets it. The
+// interface uses the device's MTU, if it is smaller.
+#ifndef NETMTU
+#define NETMTU 1500
+#endif
+#if NETMTU < 576 || NETMTU > 9000
+#error "NETMTU must be between 576 and 9000"
+#endif
+// full-sized segments fill a frame.
+#define TCP_MSS (NETMTU - 40)
+
+// received frames go into pool pbufs the size of the NIC's
+// receive buffers, chained if a frame takes more than one.
+#define PBUF_POOL_BUFSIZE 2048
+#define PBUF_POOL_SIZE 32
+
 #define LWIP_NETIF_LOOPBACK 1
+#define LWIP_NETIF_STATUS_CALLBACK 1
 
 #define LWIP_DEBUG 1
+
+// 32-bit counters, so netstat doesn't see them wrap under load.
+#define LWIP_STATS_LARGE 1
 //#define TCP_DEBUG LWIP_DBG_ON
 //#define DHCP_DEBUG LWIP_DBG_ON
 //#define NETIF_DEBUG LWIP_DBG_ON
@@ -1,3 +1,8 @@
 LWIP_MALLOC_MEMPOOL_START
+LWIP_MALLOC_MEMPOOL(8, 256)
 LWIP_MALLOC_MEMPOOL(4, 2048)
+#if NETMTU > 1500
+// jumbo frames, and TCP segments to fill them (NETMTU <= 9000)
+LWIP_MALLOC_MEMPOOL(8, 9216)
+#endif
 LWIP_MALLOC_MEMPOOL_END
@@ -25,6 +25,10 @@ main()
     kvminithart();   // turn on paging
     procinit();      // process table
     trapinit();      // trap vectors
+    profinit();      // sampling profiler
+    futexinit();     // futex wait queues
+    shminit();       // shared-memory segments
+    textinit();      // cached program images
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
@@ -34,6 +38,8 @@ main()
     virtio_disk_init(); // emulated hard disk
     netinit();       // network
     sockinit();      // socket
+    unixinit();      // AF_UNIX sockets
+    resolvinit();    // DNS lookups
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
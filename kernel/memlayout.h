@@ -64,6 +64,11 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   SHMVA(0) .. SHMVA(NSHMAT-1) (shared-memory segments, see shm.c)
+//   THREADFRAME(NTHREAD-1) .. THREADFRAME(1) (trapframes of clone()d threads)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define THREADFRAME(i) (TRAPFRAME - (i)*PGSIZE)
+#define SHMBASE (THREADFRAME(NTHREAD-1) - NSHMAT*SHMMAXPG*PGSIZE)
+#define SHMVA(i) (SHMBASE + (i)*SHMMAXPG*PGSIZE)
@@ -4,82 +4,318 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "netstat.h"
+
+#ifndef NETIP
+#define NETIP ""        // use DHCP
+#define NETMASK ""
+#define NETGW ""
+#endif
 #include "lwip/dhcp.h"
 #include "lwip/etharp.h"
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/timeouts.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/stats.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+
+#define NRXBATCH 8      // frames linkinput() takes from the driver at once
 
 struct netif netif;
 struct spinlock lwip_lock;
 
+// linkinput() counters, protected by lwip_lock.
+static uint64 rx_nobuf;   // no pbuf for an incoming frame
+static uint64 rx_drop;    // frame refused by netif->input
+static uint64 rx_gro;     // segment merged by gro
+static uint64 rx_chain;   // frame longer than one pool pbuf
+
+// r_mtime() when the frame lwIP is processing left the driver,
+// or 0 outside linkinput(); see netrxtime().
+static uint64 rxtime;
+
 err_t
 linkoutput(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf *q;
+  // a chain of pbufs is one frame; gather it first.
+  // protected by lwip_lock.
+  static char frame[SIZEOF_ETH_HDR + NETMTU];
 
-  for (q = p; q; q = q->next) {
-    if(virtio_net_send(q->payload, q->len))
+  if(p->next){
+    if(p->tot_len > sizeof(frame))
+      return ERR_IF;
+    pbuf_copy_partial(p, frame, p->tot_len, 0);
+    if(virtio_net_send(frame, p->tot_len))
       return ERR_IF;
+  } else if(virtio_net_send(p->payload, p->len)){
+    return ERR_IF;
   }
 
   return ERR_OK;
 }
 
-int
-linkinput(struct netif *netif)
+// Software GRO: linkinput() merges a run of in-order TCP data
+// segments of one connection from the same batch of frames into
+// one big segment, so lwIP's input path, the socket's ring copy,
+// tcp_recved() and the reader's wakeup happen once per run rather
+// than once per segment. The merged segment carries the first
+// segment's headers with the last one's ACK and window.
+//
+// Instead of summing the data again, gro works out each segment's
+// data checksum from its TCP checksum and headers, and gives the
+// merged segment the checksum it has if every segment was intact;
+// lwIP still checks it over all the data, so a damaged segment
+// makes the whole run fail and the peer resends it.
+static struct gro {
+  struct pbuf *p;              // first frame, with the rest chained on
+  struct ip_hdr *ip;
+  struct tcp_hdr *tcp;
+  u16_t hlen;                  // TCP header length
+  u32_t len;                   // data bytes in the run
+  u32_t datasum;               // ones'-complement sum of the data
+  u32_t ack, wnd;              // last segment's, network byte order
+  u8_t flags;
+  int n;                       // segments in the run
+  uint64 rxtime;               // when the first left the driver
+} gro;
+
+// ones'-complement sum of len bytes at data.
+static u32_t
+grosum(const void *data, u16_t len)
+{
+  return (u16_t)~inet_chksum(data, len);
+}
+
+// sum of the TCP pseudo-header for ip with tcplen TCP bytes.
+static u32_t
+gropseudo(struct ip_hdr *ip, u16_t tcplen)
 {
-  int len;
-  struct pbuf *p;
+  u8_t ph[12];
 
-  p = pbuf_alloc(PBUF_RAW, 1514, PBUF_RAM);
-  if(!p)
+  memmove(ph, &ip->src, 4);
+  memmove(ph + 4, &ip->dest, 4);
+  ph[8] = 0;
+  ph[9] = IP_PROTO_TCP;
+  ph[10] = tcplen >> 8;
+  ph[11] = tcplen;
+  return grosum(ph, sizeof(ph));
+}
+
+// If frame p is a TCP segment gro can merge, i.e. IPv4 without
+// options or fragments, carrying data and no flags but ACK and
+// PSH, return its TCP header and data length; otherwise 0.
+static struct tcp_hdr*
+grotcp(struct pbuf *p, u16_t *datalen)
+{
+  struct ip_hdr *ip;
+  struct tcp_hdr *tcp;
+  u16_t iplen, hlen;
+
+  if(p->len != p->tot_len || p->len < SIZEOF_ETH_HDR + IP_HLEN + TCP_HLEN)
+    return 0;
+  if(((struct eth_hdr*)p->payload)->type != PP_HTONS(ETHTYPE_IP))
+    return 0;
+  ip = (struct ip_hdr*)((char*)p->payload + SIZEOF_ETH_HDR);
+  if(IPH_V(ip) != 4 || IPH_HL_BYTES(ip) != IP_HLEN || IPH_PROTO(ip) != IP_PROTO_TCP)
     return 0;
+  if((IPH_OFFSET(ip) & PP_HTONS(IP_MF | IP_OFFMASK)) != 0)
+    return 0;
+  iplen = lwip_ntohs(IPH_LEN(ip));
+  if(iplen > p->len - SIZEOF_ETH_HDR)
+    return 0;
+  tcp = (struct tcp_hdr*)((char*)ip + IP_HLEN);
+  hlen = TCPH_HDRLEN_BYTES(tcp);
+  if(hlen < TCP_HLEN || IP_HLEN + hlen >= iplen)
+    return 0;
+  if(TCPH_FLAGS(tcp) != TCP_ACK && TCPH_FLAGS(tcp) != (TCP_ACK | TCP_PSH))
+    return 0;
+  *datalen = iplen - IP_HLEN - hlen;
+  return tcp;
+}
 
-  len = virtio_net_recv(p->payload, p->len);
+// sum of the data of the segment whose headers are ip and
+// tcp, assuming its checksum is right.
+static u32_t
+grodatasum(struct ip_hdr *ip, struct tcp_hdr *tcp, u16_t hlen, u16_t datalen)
+{
+  u32_t sum = gropseudo(ip, hlen + datalen) + grosum(tcp, hlen);
 
-  if(len > 0){
-    /* shrink pbuf to actual size */
-    pbuf_realloc(p, len);
+  sum = FOLD_U32T(sum);
+  return (u16_t)~FOLD_U32T(sum);
+}
 
-    printf("linkinput: received %d bytes\n", len);
-    if(netif->input(p, netif) == ERR_OK)
-      return len;
+// hand the run to lwIP.
+static void
+groflush(struct netif *netif)
+{
+  struct pbuf *p = gro.p;
+  u32_t sum;
+
+  if(p == 0)
+    return;
+  gro.p = 0;
 
-    printf("linkinput: drop packet (%d bytes)\n", len);
+  if(gro.n > 1){
+    IPH_LEN_SET(gro.ip, lwip_htons(IP_HLEN + gro.hlen + gro.len));
+    IPH_CHKSUM_SET(gro.ip, 0);
+    IPH_CHKSUM_SET(gro.ip, inet_chksum(gro.ip, IP_HLEN));
+    gro.tcp->ackno = gro.ack;
+    gro.tcp->wnd = gro.wnd;
+    TCPH_FLAGS_SET(gro.tcp, gro.flags);
+    gro.tcp->chksum = 0;
+    sum = gropseudo(gro.ip, gro.hlen + gro.len) + grosum(gro.tcp, gro.hlen) + gro.datasum;
+    sum = FOLD_U32T(sum);
+    gro.tcp->chksum = ~FOLD_U32T(sum);
   }
 
-  pbuf_free(p);
-  return len;
+  rxtime = gro.rxtime;
+  if(netif->input(p, netif) != ERR_OK){
+    printf("linkinput: drop packet (%d bytes)\n", p->tot_len);
+    rx_drop++;
+    pbuf_free(p);
+  }
+  rxtime = 0;
+}
+
+// Add frame p, which arrived at t, to the run if it continues
+// it; otherwise flush the run and start a new one with p, or
+// pass p straight to lwIP.
+static void
+groinput(struct netif *netif, struct pbuf *p, uint64 t)
+{
+  struct ip_hdr *ip;
+  struct tcp_hdr *tcp;
+  u16_t datalen, hlen;
+
+  if((tcp = grotcp(p, &datalen)) == 0){
+    groflush(netif);
+    gro.p = p;
+    gro.n = 1;
+    gro.rxtime = t;
+    groflush(netif);
+    return;
+  }
+  ip = (struct ip_hdr*)((char*)p->payload + SIZEOF_ETH_HDR);
+  hlen = TCPH_HDRLEN_BYTES(tcp);
+  // drop Ethernet padding.
+  pbuf_realloc(p, SIZEOF_ETH_HDR + IP_HLEN + hlen + datalen);
+
+  // the data sums only concatenate at even offsets.
+  if(gro.p && (gro.len & 1) == 0 &&
+     gro.len + datalen + IP_HLEN + hlen <= 0xffff &&
+     memcmp(&ip->src, &gro.ip->src, 8) == 0 &&
+     tcp->src == gro.tcp->src && tcp->dest == gro.tcp->dest &&
+     lwip_ntohl(tcp->seqno) == lwip_ntohl(gro.tcp->seqno) + gro.len &&
+     hlen == gro.hlen &&
+     memcmp((char*)tcp + TCP_HLEN, (char*)gro.tcp + TCP_HLEN, hlen - TCP_HLEN) == 0){
+    u32_t sum = gro.datasum + grodatasum(ip, tcp, hlen, datalen);
+    gro.datasum = FOLD_U32T(sum);
+    gro.len += datalen;
+    gro.ack = tcp->ackno;
+    gro.wnd = tcp->wnd;
+    gro.flags |= TCPH_FLAGS(tcp);
+    gro.n++;
+    pbuf_remove_header(p, SIZEOF_ETH_HDR + IP_HLEN + hlen);
+    pbuf_cat(gro.p, p);
+    rx_gro++;
+    return;
+  }
+
+  groflush(netif);
+  gro.p = p;
+  gro.ip = ip;
+  gro.tcp = tcp;
+  gro.hlen = hlen;
+  gro.len = datalen;
+  gro.datasum = grodatasum(ip, tcp, hlen, datalen);
+  gro.ack = tcp->ackno;
+  gro.wnd = tcp->wnd;
+  gro.flags = TCPH_FLAGS(tcp);
+  gro.n = 1;
+  gro.rxtime = t;
+}
+
+// Take up to NRXBATCH frames from the driver, through gro, into
+// lwIP. Returns the bytes received.
+int
+linkinput(struct netif *netif)
+{
+  int i, len, off, total = 0;
+  struct pbuf *p, *q;
+
+  for(i = 0; i < NRXBATCH && (len = virtio_net_rxlen()) > 0; i++){
+    // pool pbufs are the size of the driver's receive buffers;
+    // a longer frame gets a chain of them.
+    p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+    if(!p){
+      rx_nobuf++;
+      break;
+    }
+    for(q = p, off = 0; q; off += q->len, q = q->next)
+      virtio_net_rxcopy(q->payload, off, q->len);
+    virtio_net_rxdone();
+    if(p->next)
+      rx_chain++;
+    printf("linkinput: received %d bytes\n", len);
+    groinput(netif, p, r_mtime());
+    total += len;
+  }
+  groflush(netif);
+  return total;
 }
 
 err_t
 linkinit(struct netif *netif)
 {
-  virtio_net_init(&netif->hwaddr);
+  netif->mtu = virtio_net_init(&netif->hwaddr, NETMTU);
+  printf("net: mtu %d\n", netif->mtu);
 
   netif->hwaddr_len = ETH_HWADDR_LEN;
   netif->linkoutput = linkoutput;
   netif->output = etharp_output;
-  netif->mtu = 1500;
   netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET;
 
   return ERR_OK;
 }
 
+// set once the interface has an address; protected by lwip_lock.
+static int netup;
+
+// lwIP calls this when the interface comes up or its address
+// changes, e.g. when DHCP gets a lease.
+static void
+netstatus(struct netif *netif)
+{
+  char addr[IPADDR_STRLEN_MAX], netmask[IPADDR_STRLEN_MAX], gw[IPADDR_STRLEN_MAX];
+
+  if(!netif_is_up(netif) || ip4_addr_isany_val(*netif_ip4_addr(netif)))
+    return;
+  ipaddr_ntoa_r(netif_ip_addr4(netif), addr, sizeof(addr));
+  ipaddr_ntoa_r(netif_ip_netmask4(netif), netmask, sizeof(netmask));
+  ipaddr_ntoa_r(netif_ip_gw4(netif), gw, sizeof(gw));
+  printf("net: addr %s netmask %s gw %s\n", addr, netmask, gw);
+
+  netup = 1;
+  wakeup(&netup);
+}
+
 void
 netadd(void)
 {
   int i;
-  char addr[IPADDR_STRLEN_MAX], netmask[IPADDR_STRLEN_MAX], gw[IPADDR_STRLEN_MAX];
+  ip4_addr_t addr, netmask, gw;
 
   if(!netif_add_noaddr(&netif, NULL, linkinit, netif_input))
     panic("netadd");
 
   netif.name[0] = 'e';
   netif.name[1] = 'n';
-  netif_set_link_up(&netif);
-  netif_set_up(&netif);
+  netif_set_status_callback(&netif, netstatus);
 
   printf("net: mac ");
   for(i = 0; i < ETH_HWADDR_LEN; ++i){
@@ -91,17 +327,39 @@ netadd(void)
   }
   printf("\n");
 
-  dhcp_start(&netif);
-  /* wait until DHCP succeeds */
-  while(!dhcp_supplied_address(&netif)){
-    linkinput(&netif);
-    sys_check_timeouts();
-  }
+  // a static address (see NETIP in the Makefile) is ready at once.
+  if(NETIP[0] && ip4addr_aton(NETIP, &addr) && ip4addr_aton(NETMASK, &netmask) &&
+     ip4addr_aton(NETGW, &gw))
+    netif_set_addr(&netif, &addr, &netmask, &gw);
+  netif_set_link_up(&netif);
+  netif_set_up(&netif);
 
-  ipaddr_ntoa_r(netif_ip_addr4(&netif), addr, sizeof(addr));
-  ipaddr_ntoa_r(netif_ip_netmask4(&netif), netmask, sizeof(netmask));
-  ipaddr_ntoa_r(netif_ip_gw4(&netif), gw, sizeof(gw));
-  printf("net: addr %s netmask %s gw %s\n", addr, netmask, gw);
+  // otherwise DHCP runs from nettimer(), without holding up boot.
+  if(!netup)
+    dhcp_start(&netif);
+}
+
+// Wait until the interface has an address, so that sockets
+// used early on do not send from 0.0.0.0. Traffic to dst, in
+// network byte order, does not wait if it stays on loopback.
+// Returns 0, or -1 if killed while waiting.
+int
+netwait(uint32 dst)
+{
+  ip4_addr_t a = { .addr = dst };
+
+  if(ip4_addr_isloopback(&a))
+    return 0;
+  acquire(&lwip_lock);
+  while(!netup){
+    if(myproc()->killed){
+      release(&lwip_lock);
+      return -1;
+    }
+    sleep(&netup, &lwip_lock);
+  }
+  release(&lwip_lock);
+  return 0;
 }
 
 int
@@ -109,6 +367,9 @@ nettimer(void)
 {
   acquire(&lwip_lock);
   sys_check_timeouts();
+  // deliver packets sent to ourselves (127.0.0.1 or our own
+  // address); with NO_SYS, lwIP only queues them.
+  netif_poll_all();
   int rc = linkinput(&netif);
   release(&lwip_lock);
   return rc;
@@ -123,6 +384,75 @@ netinit(void)
   netif_set_default(&netif);
 }
 
+// When did the frame lwIP is processing arrive from the
+// driver? 0 if lwIP is not processing a new frame. Lets
+// socket callbacks measure time spent in lwIP.
+uint64
+netrxtime(void)
+{
+  return rxtime;
+}
+
+static void
+protostat(struct netstat_proto *ns, struct stats_proto *s)
+{
+  ns->xmit = s->xmit;
+  ns->recv = s->recv;
+  ns->drop = s->drop;
+  ns->chkerr = s->chkerr;
+  ns->lenerr = s->lenerr;
+  ns->memerr = s->memerr;
+  ns->rterr = s->rterr;
+  ns->proterr = s->proterr;
+  ns->err = s->err;
+}
+
+// Copy lwIP's, the driver's and the socket layer's
+// statistics to a struct netstat at user address addr.
+int
+netstat(uint64 addr)
+{
+  struct netstat *ns;
+  const struct stats_mem *m;
+  int i, r;
+
+  // too big for the kernel stack.
+  _Static_assert(sizeof(struct netstat) <= PGSIZE, "struct netstat exceeds a page");
+  if((ns = (struct netstat*)kalloc()) == 0)
+    return -1;
+  memset(ns, 0, sizeof(*ns));
+
+  acquire(&lwip_lock);
+  protostat(&ns->proto[NS_LINK], &lwip_stats.link);
+  protostat(&ns->proto[NS_ETHARP], &lwip_stats.etharp);
+  protostat(&ns->proto[NS_IP], &lwip_stats.ip);
+  protostat(&ns->proto[NS_ICMP], &lwip_stats.icmp);
+  protostat(&ns->proto[NS_UDP], &lwip_stats.udp);
+  protostat(&ns->proto[NS_TCP], &lwip_stats.tcp);
+  for(i = 0; i < MEMP_MAX && ns->npool < NS_NPOOL; i++){
+    if((m = lwip_stats.memp[i]) == 0)
+      continue;
+    struct netstat_pool *pool = &ns->pool[ns->npool++];
+    safestrcpy(pool->name, m->name ? m->name : "?", sizeof(pool->name));
+    pool->avail = m->avail;
+    pool->used = m->used;
+    pool->max = m->max;
+    pool->err = m->err;
+  }
+  ns->rx_nobuf = rx_nobuf;
+  ns->rx_drop = rx_drop;
+  ns->rx_gro = rx_gro;
+  ns->rx_chain = rx_chain;
+  socknetstat(ns);
+  release(&lwip_lock);
+
+  virtio_net_stats(ns);
+
+  r = copyout(myproc()->pagetable, addr, (char*)ns, sizeof(*ns));
+  kfree(ns);
+  return r;
+}
+
 uint32
 sys_now(void)
 {
@@ -0,0 +1,68 @@
+// Network statistics returned by netstat().
+
+// Counters kept by lwIP for each protocol layer.
+struct netstat_proto {
+  uint32 xmit;       // Packets sent
+  uint32 recv;       // Packets received
+  uint32 drop;       // Packets dropped
+  uint32 chkerr;     // Checksum errors
+  uint32 lenerr;     // Invalid length errors
+  uint32 memerr;     // Out of memory errors
+  uint32 rterr;      // Routing errors
+  uint32 proterr;    // Protocol errors
+  uint32 err;        // Other errors
+};
+
+enum { NS_LINK, NS_ETHARP, NS_IP, NS_ICMP, NS_UDP, NS_TCP, NS_NPROTO };
+
+// An lwIP memory pool (memp).
+struct netstat_pool {
+  char name[16];
+  uint32 avail;      // Elements in the pool
+  uint32 used;       // Elements in use now
+  uint32 max;        // Most elements ever in use
+  uint32 err;        // Allocations refused because the pool was empty
+};
+
+// One open socket.
+struct netstat_sock {
+  int pid;           // Owner
+  int fd;
+  int state;         // socket_state in socket.h
+  int tcpstate;      // lwIP's enum tcp_state, or -1 without a pcb
+  uint32 laddr, raddr;  // Addresses, network byte order
+  uint16 lport, rport;  // Ports, host byte order
+  uint32 recvq;      // Received bytes not yet read
+  uint32 sndbuf;     // Free space in lwIP's send buffer
+  uint32 sndqueue;   // Segments queued in lwIP for sending
+  uint32 unacked;    // Bytes written but not yet acknowledged
+  uint64 bytes_in;   // Bytes received
+  uint64 bytes_out;  // Bytes written
+  uint64 sent_len;   // Bytes acknowledged by the peer
+};
+
+#define NS_NPOOL 16
+
+struct netstat {
+  struct netstat_proto proto[NS_NPROTO];
+
+  int npool;
+  struct netstat_pool pool[NS_NPOOL];
+
+  // virtio-net driver
+  uint64 rx_frames;
+  uint64 rx_bytes;
+  uint64 tx_frames;
+  uint64 tx_bytes;
+  uint64 tx_ring_full;  // Frames dropped because the TX ring was full
+  uint64 rx_nobuf;      // Frames left in the ring for lack of a pbuf
+  uint64 rx_drop;       // Frames refused by lwIP's input
+  uint64 rx_gro;        // TCP segments merged into the one before
+  uint64 rx_chain;      // Frames received as a chain of pool pbufs
+
+  // socket layer
+  uint64 recv_errmem;   // sock_recv() data held back for lack of ring space
+
+  int nsock;
+  struct netstat_sock sock[NSOCK];
+};
@@ -1,6 +1,11 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NTHREAD      16  // maximum threads sharing an address space
+#define NSHM         16  // maximum shared-memory segments
+#define NSHMAT        8  // segments attached per address space
+#define SHMMAXPG    256  // maximum pages in a shared-memory segment
+#define NTEXT        16  // program images cached for exec
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -12,4 +17,5 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TIMERINTERVAL 1000000 // cycles between clock ticks; about 1/10th second in qemu
 
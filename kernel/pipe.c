@@ -7,18 +7,42 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+// A pipe's data lives in a ring of whole pages, allocated the
+// first time the writer reaches them. The ring holds PIPESIZE
+// bytes unless fcntl(F_SETPIPE_SZ) changes it; sizes are a
+// power of two so that nread and nwrite may wrap.
+#define PIPESIZE (16*PGSIZE)
+#define PIPEMAXPAGES 64
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  uint size;      // bytes in the ring
+  char *pages[PIPEMAXPAGES];
 };
 
+// Allocate a pipe with both ends open, not yet attached to
+// files; AF_UNIX sockets use a pair of these.
+struct pipe*
+pipecreate(void)
+{
+  struct pipe *pi;
+
+  if((pi = (struct pipe*)kalloc()) == 0)
+    return 0;
+  memset(pi, 0, sizeof(*pi));
+  pi->readopen = 1;
+  pi->writeopen = 1;
+  pi->size = PIPESIZE;
+  initlock(&pi->lock, "pipe");
+  return pi;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,13 +52,8 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = pipecreate()) == 0)
     goto bad;
-  pi->readopen = 1;
-  pi->writeopen = 1;
-  pi->nwrite = 0;
-  pi->nread = 0;
-  initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -55,6 +74,15 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+static void
+pipefree(struct pipe *pi)
+{
+  for(int i = 0; i < PIPEMAXPAGES; i++)
+    if(pi->pages[i])
+      kfree(pi->pages[i]);
+  kfree((char*)pi);
+}
+
 void
 pipeclose(struct pipe *pi, int writable)
 {
@@ -68,15 +96,37 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
+// Address of byte pos in the ring, and in *n the number of
+// bytes that follow it contiguously, at most max. Allocates
+// the page if need be; returns 0 if that fails.
+static char*
+pipeaddr(struct pipe *pi, uint pos, uint max, uint *n)
+{
+  uint off = pos & (pi->size - 1);
+  char **pg = &pi->pages[off / PGSIZE];
+
+  if(*pg == 0 && (*pg = kalloc()) == 0)
+    return 0;
+  *n = PGSIZE - off % PGSIZE;
+  if(*n > max)
+    *n = max;
+  return *pg + off % PGSIZE;
+}
+
+// Write n bytes from user address addr. Unless nonblocking,
+// waits for room; otherwise returns what fit, or -1 with
+// EAGAIN if nothing did.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblocking)
 {
   int i = 0;
+  uint m;
+  char *dst;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,16 +135,28 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(pi->nwrite == pi->nread + pi->size){ //DOC: pipewrite-full
+      if(nonblocking){
+        if(i == 0){
+          release(&pi->lock);
+          pr->error_no = EAGAIN;
+          return -1;
+        }
+        break;
+      }
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      continue;
     }
+    m = pi->nread + pi->size - pi->nwrite;
+    if(m > n - i)
+      m = n - i;
+    if((dst = pipeaddr(pi, pi->nwrite, m, &m)) == 0)
+      break;
+    if(copyin(pr->pagetable, dst, addr + i, m) == -1)
+      break;
+    pi->nwrite += m;
+    i += m;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
@@ -102,29 +164,169 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   return i;
 }
 
+// Wait until pi has data or no writer, unless nowait.
+// Returns -1 if killed. Caller holds pi->lock.
+static int
+pipewaitdata(struct pipe *pi, int nowait)
+{
+  while(pi->nread == pi->nwrite && pi->writeopen && !nowait){  //DOC: pipe-empty
+    if(myproc()->killed)
+      return -1;
+    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+  }
+  return 0;
+}
+
+// Read up to n bytes to user address addr. Waits for data
+// unless nonblocking, when it returns -1 with EAGAIN instead.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int nonblocking)
 {
-  int i;
+  int i = 0;
+  uint m;
+  char *src;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(pr->killed){
-      release(&pi->lock);
-      return -1;
-    }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+  if(nonblocking && pi->nread == pi->nwrite && pi->writeopen){
+    release(&pi->lock);
+    pr->error_no = EAGAIN;
+    return -1;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  if(pipewaitdata(pi, 0) < 0){
+    release(&pi->lock);
+    return -1;
+  }
+  while(i < n && pi->nread != pi->nwrite){  //DOC: piperead-copy
+    m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    src = pipeaddr(pi, pi->nread, m, &m);  // page exists: it holds data
+    if(copyout(pr->pagetable, addr + i, src, m) == -1)
       break;
+    pi->nread += m;
+    i += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Hand up to n buffered bytes straight from the pipe's pages
+// to sink, one contiguous run at a time, for splice(). sink
+// returns how many bytes of a run it took; it is called with
+// pi->lock held and must not sleep. Waits for data unless
+// nowait. Returns the number of bytes consumed, or -1.
+int
+pipeconsume(struct pipe *pi, int n, int nowait,
+            int (*sink)(void*, char*, int), void *arg)
+{
+  int i = 0, k;
+  uint m;
+  char *src;
+
+  acquire(&pi->lock);
+  if(pipewaitdata(pi, nowait) < 0){
+    release(&pi->lock);
+    return -1;
+  }
+  while(i < n && pi->nread != pi->nwrite){
+    m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    src = pipeaddr(pi, pi->nread, m, &m);
+    k = sink(arg, src, m);
+    pi->nread += k;
+    i += k;
+    if(k < m)
+      break;
+  }
+  if(i > 0)
+    wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return i;
+}
+
+// Return 1 if pi is empty and its write end is closed.
+int
+pipeeof(struct pipe *pi)
+{
+  int eof;
+
+  acquire(&pi->lock);
+  eof = pi->nread == pi->nwrite && !pi->writeopen;
+  release(&pi->lock);
+  return eof;
+}
+
+// Would a read not block: is there data, or no writer?
+int
+pipereadable(struct pipe *pi)
+{
+  return pi->nread != pi->nwrite || !pi->writeopen;
+}
+
+// Would a write not block: is there room, or no reader?
+int
+pipewritable(struct pipe *pi)
+{
+  return pi->nwrite != pi->nread + pi->size || !pi->readopen;
+}
+
+// The ring size, for fcntl(F_GETPIPE_SZ).
+int
+pipegetsize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Resize the ring to at least n bytes, rounded up to a power
+// of two number of pages, for fcntl(F_SETPIPE_SZ). Fails if
+// the buffered data would not fit. Returns the new size or -1.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  char *pages[PIPEMAXPAGES], *p;
+  uint size, len, pos, m, i;
+
+  if(n <= 0 || n > PIPEMAXPAGES*PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size *= 2)
+    ;
+
+  acquire(&pi->lock);
+  len = pi->nwrite - pi->nread;
+  if(len > size){
+    release(&pi->lock);
+    return -1;
+  }
+
+  // copy the data to the start of a fresh set of pages.
+  memset(pages, 0, sizeof(pages));
+  for(i = 0; i < PGROUNDUP(len) / PGSIZE; i++){
+    if((pages[i] = kalloc()) == 0){
+      while(i-- > 0)
+        kfree(pages[i]);
+      release(&pi->lock);
+      return -1;
+    }
+  }
+  for(pos = 0; pos < len; pos += m){
+    p = pipeaddr(pi, pi->nread + pos, len - pos, &m);
+    if(m > PGSIZE - pos % PGSIZE)
+      m = PGSIZE - pos % PGSIZE;
+    memmove(pages[pos / PGSIZE] + pos % PGSIZE, p, m);
+  }
+
+  for(i = 0; i < PIPEMAXPAGES; i++){
+    if(pi->pages[i])
+      kfree(pi->pages[i]);
+    pi->pages[i] = pages[i];
+  }
+  pi->size = size;
+  pi->nread = 0;
+  pi->nwrite = len;
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return size;
+}
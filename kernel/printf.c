@@ -16,6 +16,7 @@
 #include "proc.h"
 
 volatile int panicked = 0;
+volatile int panicking = 0; // console output is synchronous
 
 // lock to avoid interleaving concurrent printf's.
 static struct {
@@ -137,6 +138,7 @@ void
 panic(char *s)
 {
   pr.locking = 0;
+  panicking = 1;
   printf("PANIC: ");
   printf(s);
   printf("\n");
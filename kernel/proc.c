@@ -13,13 +13,33 @@ struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// user memory and open file tables, each shared by one or
+// more procs; see clone().
+struct vmspace vmspace[NPROC];
+struct fdtable fdtable[NPROC];
+
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// Sleeping processes are queued on a bucket chosen by hashing
+// their wait channel, so wakeup() only has to look at processes
+// that might be sleeping on that channel, not all NPROC of them.
+#define NSLEEPQ 64
+#define SLEEPQ_HASH(chan) ((((uint64)(chan)) >> 3) % NSLEEPQ)
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
+#define ALLCPUS ((1 << NCPU) - 1)
+
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
+static void setrunnable(struct proc *p, int hint);
+static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -29,6 +49,14 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&cpus[i].rq.lock, "runq");
+  for(int i = 0; i < NPROC; i++){
+    initlock(&vmspace[i].lock, "vmspace");
+    initlock(&fdtable[i].lock, "fdtable");
+  }
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -86,14 +114,175 @@ allocpid() {
   return pid;
 }
 
+// Wrap a page table with the caller's trapframe at TRAPFRAME
+// in a free vmspace, or return 0 if there are none.
+static struct vmspace*
+vmalloc(pagetable_t pagetable, uint64 sz)
+{
+  struct vmspace *vm;
+
+  for(vm = vmspace; vm < &vmspace[NPROC]; vm++){
+    acquire(&vm->lock);
+    if(vm->ref == 0){
+      vm->ref = 1;
+      vm->pagetable = pagetable;
+      vm->sz = sz;
+      vm->tfslots = 1;
+      release(&vm->lock);
+      return vm;
+    }
+    release(&vm->lock);
+  }
+  return 0;
+}
+
+// Map p's trapframe into a free THREADFRAME() slot of vm
+// and make p share vm. Return 0 on success, -1 on failure.
+static int
+vmshare(struct proc *p, struct vmspace *vm)
+{
+  int i;
+
+  acquire(&vm->lock);
+  for(i = 0; i < NTHREAD; i++)
+    if((vm->tfslots & (1 << i)) == 0)
+      break;
+  // sibling threads could keep a shared image page in their
+  // TLBs after one of them copies it, so threads get their own.
+  if(i == NTHREAD || (vm->text && uvmprivate(vm->pagetable, textsize(vm->text)) < 0) ||
+     mappages(vm->pagetable, THREADFRAME(i), PGSIZE,
+              (uint64)p->trapframe, PTE_R | PTE_W) < 0){
+    release(&vm->lock);
+    return -1;
+  }
+  vm->tfslots |= 1 << i;
+  vm->ref++;
+  release(&vm->lock);
+
+  p->vm = vm;
+  p->pagetable = vm->pagetable;
+  p->tfva = THREADFRAME(i);
+  return 0;
+}
+
+// Drop a reference to vm by the proc whose trapframe is
+// mapped at tfva. The last one frees the user memory.
+static void
+vmput(struct vmspace *vm, uint64 tfva)
+{
+  pagetable_t pagetable;
+  struct text *text;
+  uint64 sz;
+
+  acquire(&vm->lock);
+  vm->tfslots &= ~(1 << ((TRAPFRAME - tfva) / PGSIZE));
+  if(--vm->ref > 0){
+    uvmunmap(vm->pagetable, tfva, PGSIZE, 0);
+    release(&vm->lock);
+    return;
+  }
+  shmdetachall(vm);
+  pagetable = vm->pagetable;
+  sz = vm->sz;
+  text = vm->text;
+  vm->pagetable = 0;
+  vm->sz = 0;
+  vm->text = 0;
+  release(&vm->lock);
+
+  proc_freepagetable(pagetable, tfva, sz);
+  textput(text);
+}
+
+// Switch p to the user memory exec() built in pagetable,
+// which maps text on demand; vm takes over the caller's
+// reference to text. A thread that calls exec() leaves its
+// siblings running the old program. Return 0 on success,
+// -1 on failure.
+int
+vmreplace(struct proc *p, pagetable_t pagetable, uint64 sz, struct text *text)
+{
+  struct vmspace *vm = p->vm;
+  pagetable_t oldpagetable;
+  struct text *oldtext;
+  uint64 oldsz;
+
+  acquire(&vm->lock);
+  if(vm->ref == 1){
+    // not shared, so reuse vm.
+    shmdetachall(vm);
+    oldpagetable = vm->pagetable;
+    oldsz = vm->sz;
+    oldtext = vm->text;
+    vm->pagetable = pagetable;
+    vm->sz = sz;
+    vm->text = text;
+    vm->tfslots = 1;
+    release(&vm->lock);
+    proc_freepagetable(oldpagetable, p->tfva, oldsz);
+    textput(oldtext);
+  } else {
+    release(&vm->lock);
+    if((vm = vmalloc(pagetable, sz)) == 0)
+      return -1;
+    vm->text = text;
+    vmput(p->vm, p->tfva);
+    p->vm = vm;
+  }
+  p->pagetable = pagetable;
+  p->tfva = TRAPFRAME;
+  return 0;
+}
+
+// Find an unused open file table, or return 0.
+static struct fdtable*
+fdtalloc(void)
+{
+  struct fdtable *fdt;
+
+  for(fdt = fdtable; fdt < &fdtable[NPROC]; fdt++){
+    acquire(&fdt->lock);
+    if(fdt->ref == 0){
+      fdt->ref = 1;
+      release(&fdt->lock);
+      return fdt;
+    }
+    release(&fdt->lock);
+  }
+  return 0;
+}
+
+// Drop a reference to fdt. The last one closes the files.
+static void
+fdtput(struct fdtable *fdt)
+{
+  struct file *ofile[NOFILE];
+
+  acquire(&fdt->lock);
+  if(--fdt->ref > 0){
+    release(&fdt->lock);
+    return;
+  }
+  memmove(ofile, fdt->ofile, sizeof(ofile));
+  memset(fdt->ofile, 0, sizeof(fdt->ofile));
+  release(&fdt->lock);
+
+  for(int fd = 0; fd < NOFILE; fd++)
+    if(ofile[fd])
+      fileclose(ofile[fd]);
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
+// The new proc shares user memory and open files with
+// share if it is not 0, and otherwise gets empty ones.
 // If there are no free procs, return 0.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *share)
 {
   struct proc *p;
+  pagetable_t pagetable;
 
   for(p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
@@ -107,6 +296,8 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->affinity = ALLCPUS;
+  p->cpu = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -114,8 +305,26 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
+  if(share){
+    if(vmshare(p, share->vm) < 0)
+      goto bad;
+    p->fdt = share->fdt;
+    acquire(&p->fdt->lock);
+    p->fdt->ref++;
+    release(&p->fdt->lock);
+  } else {
+    // An empty user page table.
+    pagetable = proc_pagetable(p);
+    if((p->vm = vmalloc(pagetable, 0)) == 0){
+      proc_freepagetable(pagetable, TRAPFRAME, 0);
+      goto bad;
+    }
+    p->pagetable = pagetable;
+    p->tfva = TRAPFRAME;
+    if((p->fdt = fdtalloc()) == 0)
+      goto bad;
+  }
+  p->ofile = p->fdt->ofile;
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -124,27 +333,39 @@ found:
   p->context.sp = p->kstack + PGSIZE;
 
   return p;
+
+bad:
+  freeproc(p);
+  release(&p->lock);
+  return 0;
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages if no other thread uses them.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  if(p->vm)
+    vmput(p->vm, p->tfva);
+  p->vm = 0;
+  p->pagetable = 0;
+  p->tfva = 0;
+  if(p->fdt)
+    fdtput(p->fdt);
+  p->fdt = 0;
+  p->ofile = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
+  p->walkcache.pagetable = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->lastread = 0;
   p->state = UNUSED;
 }
 
@@ -172,13 +393,13 @@ proc_pagetable(struct proc *p)
   return pagetable;
 }
 
-// Free a process's page table, and free the
-// physical memory it refers to.
+// Free a process's page table, whose last trapframe is
+// mapped at tfva, and free the physical memory it refers to.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+proc_freepagetable(pagetable_t pagetable, uint64 tfva, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, PGSIZE, 0);
-  uvmunmap(pagetable, TRAPFRAME, PGSIZE, 0);
+  uvmunmap(pagetable, tfva, PGSIZE, 0);
   if(sz > 0)
     uvmfree(pagetable, sz);
 }
@@ -201,13 +422,13 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->vm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -216,29 +437,40 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p, -1);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
+// Return the old size, or -1 on failure.
+uint64
 growproc(int n)
 {
-  uint sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  struct vmspace *vm = p->vm;
 
-  sz = p->sz;
+  acquire(&vm->lock);
+  sz = oldsz = vm->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n > SHMBASE ||
+       (sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+      release(&vm->lock);
       return -1;
     }
   } else if(n < 0){
+    // other threads' CPUs may still have the pages in their
+    // TLBs, and there is no shootdown, so shared memory only grows.
+    if(vm->ref > 1){
+      release(&vm->lock);
+      return -1;
+    }
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  vm->sz = sz;
+  release(&vm->lock);
+  return oldsz;
 }
 
 // Create a new process, copying the parent.
@@ -247,23 +479,36 @@ int
 fork(void)
 {
   int i, pid;
+  uint64 sz;
   struct proc *np;
   struct proc *p = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child. a sibling thread
+  // may grow it meanwhile, but not shrink it; see growproc().
+  acquire(&p->vm->lock);
+  sz = p->vm->sz;
+  release(&p->vm->lock);
+  if(uvmcopy(p->pagetable, np->pagetable, sz) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->vm->sz = sz;
+  np->vm->text = textdup(p->vm->text);
+  if(shmfork(p->vm, np->vm) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
 
   np->parent = p;
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -272,16 +517,63 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
+  acquire(&p->fdt->lock);
   for(i = 0; i < NOFILE; i++)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
+  release(&p->fdt->lock);
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  setrunnable(np, -1);
+
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread: a new process that shares the caller's
+// user memory and open file table, and starts in user space
+// at fn(arg) on the user stack that ends at stack. It has its
+// own pid, kernel stack, trapframe, and working directory, is
+// a child of the caller for wait(), and exit()s on its own.
+// Returns the new pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(stack % 16)
+    return -1;  // riscv sp must be 16-byte aligned
+
+  if((np = allocproc(p)) == 0)
+    return -1;
+
+  np->parent = p;
+  np->affinity = p->affinity;
+  np->cpu = p->cpu;
+
+  // start at fn(arg), with a return address of 0 so that
+  // returning from fn faults rather than running on.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
+  np->trapframe->s0 = 0;
+
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  setrunnable(np, -1);
 
   release(&np->lock);
 
@@ -325,14 +617,10 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  // Close all open files, unless other threads share them.
+  fdtput(p->fdt);
+  p->fdt = 0;
+  p->ofile = 0;
 
   begin_op();
   iput(p->cwd);
@@ -434,10 +722,127 @@ wait(uint64 addr)
   }
 }
 
+// Can p be queued on cpu id? Only CPUs that have
+// entered scheduler() count, so a mask naming absent
+// CPUs can't strand a process.
+static int
+cpuok(struct proc *p, int id)
+{
+  return (p->affinity & (1 << id)) && cpus[id].rq.online;
+}
+
+// Choose the run queue for p: the hint if p may run there,
+// else the shortest queue p may run on, preferring the CPU
+// p last ran on (its cache is warm) when there is a tie.
+static int
+pickcpu(struct proc *p, int hint)
+{
+  int i, best;
+
+  if(hint >= 0 && cpuok(p, hint))
+    return hint;
+
+  best = cpuok(p, p->cpu) ? p->cpu : -1;
+  for(i = 0; i < NCPU; i++)
+    if(cpuok(p, i) && (best < 0 || cpus[i].rq.n < cpus[best].rq.n))
+      best = i;
+  if(best >= 0)
+    return best;
+
+  // none of p's CPUs is running; ignore its affinity.
+  for(i = 0; i < NCPU; i++)
+    if(cpus[i].rq.online && (best < 0 || cpus[i].rq.n < cpus[best].rq.n))
+      best = i;
+  return best >= 0 ? best : 0;
+}
+
+// Mark p RUNNABLE and append it to a CPU's run queue.
+// hint is the CPU that should preferably run p, or -1.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p, int hint)
+{
+  struct runq *rq;
+
+  if(!holding(&p->lock))
+    panic("setrunnable");
+  p->state = RUNNABLE;
+
+  rq = &cpus[pickcpu(p, hint)].rq;
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->n++;
+  release(&rq->lock);
+}
+
+// Unlink p, which follows prev (or is the head if prev is 0),
+// from rq. Caller must hold rq->lock.
+static void
+rqremove(struct runq *rq, struct proc *prev, struct proc *p)
+{
+  if(prev)
+    prev->rqnext = p->rqnext;
+  else
+    rq->head = p->rqnext;
+  if(rq->tail == p)
+    rq->tail = prev;
+  p->rqnext = 0;
+  rq->n--;
+}
+
+// Take the next process off cpu id's own run queue.
+static struct proc*
+rqpop(int id)
+{
+  struct runq *rq = &cpus[id].rq;
+  struct proc *p;
+
+  if(rq->n == 0)
+    return 0;
+  acquire(&rq->lock);
+  if((p = rq->head) != 0)
+    rqremove(rq, 0, p);
+  release(&rq->lock);
+  return p;
+}
+
+// Cpu id is idle: take the oldest process that is allowed
+// to run on id from another CPU's queue. p->affinity is read
+// without p->lock; a stale mask only costs one misplacement.
+static struct proc*
+rqsteal(int id)
+{
+  struct runq *rq;
+  struct proc *p, *prev;
+  int i;
+
+  for(i = 1; i < NCPU; i++){
+    rq = &cpus[(id + i) % NCPU].rq;
+    if(rq->n == 0)
+      continue;
+    acquire(&rq->lock);
+    for(prev = 0, p = rq->head; p; prev = p, p = p->rqnext){
+      if(p->affinity & (1 << id)){
+        rqremove(rq, prev, p);
+        release(&rq->lock);
+        return p;
+      }
+    }
+    release(&rq->lock);
+  }
+  return 0;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process from this CPU's run queue, or
+//    steal one from another CPU's if ours is empty.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -446,13 +851,15 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
+  c->rq.online = 1;
   for(;;){
     // Avoid deadlock by giving devices a chance to interrupt.
     intr_on();
 
-    // Run the for loop with interrupts off to avoid
+    // Pick a process with interrupts off to avoid
     // a race between an interrupt and WFI, which would
     // cause a lost wakeup.
     intr_off();
@@ -461,33 +868,35 @@ scheduler(void)
     if (ticks % 5 == 0)
       nettimer();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->scheduler, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-
-        found = 1;
-      }
-
-      // ensure that release() doesn't enable interrupts.
-      // again to avoid a race between interrupt and WFI.
-      c->intena = 0;
-
-      release(&p->lock);
-    }
-    if(found == 0){
+    if((p = rqpop(id)) == 0 && (p = rqsteal(id)) == 0){
       asm volatile("wfi");
+      continue;
     }
+
+    // p was queued by setrunnable() and nobody else can
+    // dequeue it, but the CPU that queued it (e.g. in yield())
+    // may still be switching away; acquire() waits for that.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    swtch(&c->scheduler, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+
+    // ensure that release() doesn't enable interrupts.
+    // again to avoid a race between interrupt and WFI.
+    c->intena = 0;
+
+    release(&p->lock);
   }
 }
 
@@ -524,7 +933,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p, -1);
   sched();
   release(&p->lock);
 }
@@ -550,21 +959,60 @@ forkret(void)
   usertrapret();
 }
 
+// Put p on wait-queue bucket q.
+// Caller must hold q->lock.
+static void
+sqinsert(struct sleepq *q, struct proc *p)
+{
+  p->sq = q;
+  p->sqprev = 0;
+  p->sqnext = q->head;
+  if(q->head)
+    q->head->sqprev = p;
+  q->head = p;
+}
+
+// Take p off its wait-queue bucket.
+// Caller must hold p->sq->lock.
+static void
+sqremove(struct proc *p)
+{
+  if(p->sqprev)
+    p->sqprev->sqnext = p->sqnext;
+  else
+    p->sq->head = p->sqnext;
+  if(p->sqnext)
+    p->sqnext->sqprev = p->sqprev;
+  p->sq = 0;
+  p->sqnext = p->sqprev = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = 0;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // Once we are on chan's wait queue and
+  // hold p->lock, we can be guaranteed that
+  // we won't miss any wakeup (wakeup locks
+  // the queue and then p->lock),
   // so it's okay to release lk.
+  // A process sleeping on its own p->lock, i.e.
+  // in wait(), is only ever woken by wakeup1()
+  // or kill(), so it doesn't need a queue; and
+  // taking the queue lock while holding p->lock
+  // would invert the order wakeup() uses.
   if(lk != &p->lock){  //DOC: sleeplock0
+    q = &sleepq[SLEEPQ_HASH(chan)];
+    acquire(&q->lock);
+    sqinsert(q, p);
     acquire(&p->lock);  //DOC: sleeplock1
+    release(&q->lock);
     release(lk);
   }
 
@@ -580,24 +1028,65 @@ sleep(void *chan, struct spinlock *lk)
   // Reacquire original lock.
   if(lk != &p->lock){
     release(&p->lock);
+
+    // still queued if kill() rather than wakeup() woke us.
+    acquire(&q->lock);
+    if(p->sq)
+      sqremove(p);
+    release(&q->lock);
+
     acquire(lk);
   }
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
-void
-wakeup(void *chan)
+// Wake up at most n processes sleeping on chan, queueing
+// them on this CPU if local is set and they may run here.
+// Returns how many were woken.
+static int
+wakeupcpu(void *chan, int local, int n)
 {
-  struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
+  struct proc *p, *next;
+  struct sleepq *q = &sleepq[SLEEPQ_HASH(chan)];
+  int hint, woken = 0;
+
+  acquire(&q->lock);
+  hint = local ? cpuid() : -1;
+  for(p = q->head; p && woken < n; p = next) {
+    next = p->sqnext;
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+      setrunnable(p, hint);
+      sqremove(p);
+      woken++;
     }
     release(&p->lock);
   }
+  release(&q->lock);
+  return woken;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeupcpu(chan, 0, NPROC);
+}
+
+// Like wakeup(), but run the woken processes on this CPU
+// if their affinity allows, so a process woken for data
+// the network stack just handled finds it in this CPU's cache.
+void
+wakeuplocal(void *chan)
+{
+  wakeupcpu(chan, 1, NPROC);
+}
+
+// Wake up at most n processes sleeping on chan, for futexwake().
+int
+wakeupn(void *chan, int n)
+{
+  return wakeupcpu(chan, 0, n);
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -608,7 +1097,7 @@ wakeup1(struct proc *p)
   if(!holding(&p->lock))
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
+    setrunnable(p, -1);
   }
 }
 
@@ -626,7 +1115,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p, -1);
       }
       release(&p->lock);
       return 0;
@@ -636,6 +1125,44 @@ kill(int pid)
   return -1;
 }
 
+// Set the CPUs the process with the given pid may run on,
+// as a bit mask of CPU ids; pid 0 means the caller and a
+// mask of 0 leaves the affinity unchanged.
+// Returns the previous mask, or -1.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p, *me = myproc();
+  int old, id;
+
+  if(mask & ~ALLCPUS)
+    return -1;
+  if(pid == 0)
+    pid = me->pid;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      old = p->affinity;
+      if(mask)
+        p->affinity = mask;
+      release(&p->lock);
+
+      // move off this CPU at once if no longer allowed here.
+      if(p == me){
+        push_off();
+        id = cpuid();
+        pop_off();
+        if((me->affinity & (1 << id)) == 0)
+          yield();
+      }
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
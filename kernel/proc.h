@@ -18,12 +18,22 @@ struct context {
   uint64 s11;
 };
 
+// A CPU's queue of RUNNABLE processes; see setrunnable() in proc.c.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;          // Next process to run
+  struct proc *tail;
+  int n;                      // Number of queued processes
+  int online;                 // Has this CPU entered scheduler()?
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context scheduler;   // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct runq rq;             // Processes waiting to run on this cpu.
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +90,34 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// Last level-0 page-table page found by copyin/copyout for
+// this process; see walkcached() in vm.c.
+struct walkcache {
+  pagetable_t pagetable;       // page table the entry belongs to
+  uint64 region;               // va >> PXSHIFT(1) of the cached region
+  pte_t *l0;                   // level-0 page-table page for region
+  uint gen;                    // walkgen when cached
+};
+
+// User memory, shared by a process and the threads it clone()s.
+// Each of them maps its own trapframe at a THREADFRAME() slot.
+struct vmspace {
+  struct spinlock lock;
+  int ref;                     // Procs using it, or 0 if free
+  pagetable_t pagetable;       // User page table
+  uint64 sz;                   // Size of process memory (bytes)
+  uint tfslots;                // Bit i set if THREADFRAME(i) is mapped
+  struct shm *shm[NSHMAT];     // Segment attached at SHMVA(i), or 0
+  struct text *text;           // Program image exec() maps on demand
+};
+
+// Open file table, shared the same way.
+struct fdtable {
+  struct spinlock lock;        // Protects ofile[]
+  int ref;                     // Procs using it, or 0 if free
+  struct file *ofile[NOFILE];
+};
+
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -93,15 +131,29 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  uint affinity;               // Bit i set if the process may run on cpu i
+  int cpu;                     // CPU it last ran on
+
+  // the lock of the run queue the process is on must be held when using this:
+  struct proc *rqnext;         // Next process in that run queue
+
+  // the lock of the wait-queue bucket sq must be held when using these:
+  struct sleepq *sq;           // Bucket this process is queued on, or 0
+  struct proc *sqnext;         // Other sleepers in the same bucket
+  struct proc *sqprev;
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // Page table
+  struct vmspace *vm;          // User memory
+  pagetable_t pagetable;       // Page table, vm->pagetable
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // Where trapframe is mapped in pagetable
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable *fdt;         // Open file table
+  struct file **ofile;         // Open files, fdt->ofile
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int error_no;                // Error number for system calls (e.g., EAGAIN)
+  uint64 lastread;             // r_mtime() of last socket read, for socklat
+  struct walkcache walkcache;  // copyin/copyout translation cache
 };
@@ -0,0 +1,204 @@
+// Sampling profiler.
+//
+// While profiling is on, every timer interrupt records the
+// interrupted pc and a frame-pointer backtrace of the kernel
+// stack (if the CPU was in the kernel) and of the current
+// process's user stack into a per-CPU ring. profread()
+// drains the rings; user/prof prints the samples and the
+// profsym script turns them into folded stacks.
+//
+// To sample faster than the clock ticks, profctl() shortens
+// the machine-mode timer interval by a factor of profdiv, and
+// only every profdiv'th interrupt counts as a clock tick.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMPLE 256   // samples buffered per CPU
+
+struct profbuf {
+  struct spinlock lock;
+  uint head;              // next sample to read
+  uint tail;              // next slot to write
+  uint dropped;           // samples lost because the ring was full
+  struct profsample s[NPROFSAMPLE];
+};
+
+static struct profbuf profbuf[NCPU];
+static int profiling;
+static int profdiv = 1;
+static int profcount[NCPU];
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+// Called on every timer interrupt.  Returns 1 if this
+// interrupt is a clock tick, 0 if it only exists to
+// take an extra profiling sample.
+int
+proftick(void)
+{
+  int id = cpuid();
+
+  if(profdiv <= 1)
+    return 1;
+  if(++profcount[id] < profdiv)
+    return 0;
+  profcount[id] = 0;
+  return 1;
+}
+
+// Is fp a plausible kernel frame pointer?  Kernel stacks are
+// either the boot stacks in the direct-mapped kernel image or
+// per-process stack pages with a guard page below each one.
+static int
+kstackok(uint64 fp)
+{
+  if(fp & 7)
+    return 0;
+  if(fp >= KERNBASE && fp < PHYSTOP)
+    return 1;
+  if(fp >= KSTACK(NPROC-1) && fp < TRAMPOLINE)
+    return ((TRAMPOLINE - PGROUNDDOWN(fp)) / PGSIZE) % 2 == 0;
+  return 0;
+}
+
+// Append up to PROFDEPTH-s->depth return addresses to s,
+// walking kernel frames from fp; see backtrace() in printf.c.
+static void
+kwalk(struct profsample *s, uint64 fp)
+{
+  uint64 low = PGROUNDDOWN(fp) + 16, high = PGROUNDUP(fp);
+
+  if(!kstackok(fp))
+    return;
+  while(s->depth < PROFDEPTH && !(fp & 7) && fp >= low && fp < high){
+    s->pc[s->depth++] = *(uint64*)(fp - 8);
+    fp = *(uint64*)(fp - 16);
+  }
+}
+
+// Same for a user stack.  Reads through walkaddr() rather
+// than copyin(), since we may have interrupted copyin().
+static void
+uwalk(struct profsample *s, pagetable_t pagetable, uint64 fp)
+{
+  uint64 pa, prev = 0;
+
+  while(s->depth < PROFDEPTH && !(fp & 7) && fp > prev &&
+        PGROUNDDOWN(fp - 16) == PGROUNDDOWN(fp - 1)){
+    if((pa = walkaddr(pagetable, fp - 16)) == 0)
+      break;
+    pa += (fp - 16) & (PGSIZE - 1);
+    s->pc[s->depth++] = ((uint64*)pa)[1];
+    prev = fp;
+    fp = ((uint64*)pa)[0];
+  }
+}
+
+// Record one sample for this CPU.  kernel is set if the
+// interrupt came from the kernel, with pc and fp the
+// interrupted sepc and s0.  Interrupts must be off.
+void
+profsample(int kernel, uint64 pc, uint64 fp)
+{
+  struct profbuf *b;
+  struct profsample *s;
+  struct proc *p;
+  int id;
+
+  if(!profiling)
+    return;
+
+  id = cpuid();
+  b = &profbuf[id];
+  acquire(&b->lock);
+  if(b->tail - b->head == NPROFSAMPLE){
+    b->dropped++;
+    release(&b->lock);
+    return;
+  }
+  s = &b->s[b->tail % NPROFSAMPLE];
+  p = mycpu()->proc;
+  s->cpu = id;
+  s->depth = 0;
+  s->pid = p ? p->pid : 0;
+  if(p)
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  else
+    s->name[0] = 0;
+
+  if(kernel){
+    s->pc[s->depth++] = pc;
+    kwalk(s, fp);
+  }
+  s->nkernel = s->depth;
+  if(p && p->trapframe && p->pagetable && s->depth < PROFDEPTH){
+    s->pc[s->depth++] = p->trapframe->epc;
+    uwalk(s, p->pagetable, p->trapframe->s0);
+  }
+  b->tail++;
+  release(&b->lock);
+}
+
+// Start profiling with mult samples per clock tick, or
+// stop if mult is 0.  Returns the number of samples
+// dropped since the last call.
+int
+profctl(int mult)
+{
+  int i, dropped = 0;
+
+  if(mult < 0 || mult > 100)
+    return -1;
+  profiling = 0;
+  profdiv = mult > 0 ? mult : 1;
+  timerinterval(TIMERINTERVAL / profdiv);
+  profiling = mult > 0;
+
+  for(i = 0; i < NCPU; i++){
+    acquire(&profbuf[i].lock);
+    dropped += profbuf[i].dropped;
+    profbuf[i].dropped = 0;
+    release(&profbuf[i].lock);
+  }
+  return dropped;
+}
+
+// Move up to n buffered samples to user address addr.
+// Returns the number of samples copied.
+int
+profread(uint64 addr, int n)
+{
+  struct profsample s;
+  struct profbuf *b;
+  int i, cnt = 0;
+
+  for(i = 0; i < NCPU && cnt < n; i++){
+    b = &profbuf[i];
+    while(cnt < n){
+      acquire(&b->lock);
+      if(b->head == b->tail){
+        release(&b->lock);
+        break;
+      }
+      s = b->s[b->head % NPROFSAMPLE];
+      b->head++;
+      release(&b->lock);
+      if(copyout(myproc()->pagetable, addr + cnt*sizeof(s), (char*)&s, sizeof(s)) < 0)
+        return -1;
+      cnt++;
+    }
+  }
+  return cnt;
+}
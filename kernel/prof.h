@@ -0,0 +1,11 @@
+// Samples recorded by the sampling profiler (prof.c).
+#define PROFDEPTH 16     // frames kept per sample
+
+struct profsample {
+  int pid;               // Process running, or 0 if the CPU was idle
+  char name[16];         // Its name, for finding user symbols
+  short cpu;             // CPU that took the sample
+  short nkernel;         // pc[0..nkernel) are kernel addresses,
+  short depth;           // pc[nkernel..depth) user addresses
+  uint64 pc[PROFDEPTH];  // Innermost frame first
+};
@@ -0,0 +1,260 @@
+// Host name resolution.
+//
+// A lookup is a struct dnsreq, the completion object its lwIP
+// callback fills in. resolve() hands one to user space as a
+// file descriptor: read() returns the address once the lookup
+// is done, and net_poll() reports POLLIN then, so a process can
+// have several lookups outstanding at once. gethostbyname() is
+// a lookup plus a blocking wait.
+//
+// Answers are cached by lwIP's own table, which keeps up to
+// DNS_TABLE_SIZE names for the TTL of their records. Names
+// that fail to resolve are remembered here for NEGTTL ms, so
+// a bad name costs one round trip rather than one per caller.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fcntl.h"
+#include "socklat.h"
+#include "socket.h"
+#include "lwip/dns.h"
+#include "lwip/sys.h"
+
+#define NDNSREQ 16      // lookups in progress or unread
+#define NDNSNEG 8       // names in the negative cache
+#define NEGTTL 30000    // ms a failed name is remembered
+
+enum { DNS_FREE, DNS_PENDING, DNS_DONE, DNS_FAILED };
+
+struct dnsreq {
+  int state;
+  int ref;                     // open files, plus lwIP while pending
+  uint32 addr;                 // in network byte order, once done
+  char name[MAX_DOMAIN_NAME];
+};
+
+extern struct spinlock lwip_lock;
+
+// lock order: lwip_lock, then dnslock.
+static struct spinlock dnslock;
+static struct dnsreq dnsreqs[NDNSREQ];
+
+static struct {
+  char name[MAX_DOMAIN_NAME];
+  uint32 expire;               // sys_now() when it expires
+} dnsneg[NDNSNEG];
+
+void
+resolvinit(void)
+{
+  ip_addr_t server = { .addr = DNS_SERVER_IP };
+
+  initlock(&dnslock, "dns");
+  acquire(&lwip_lock);
+  dns_setserver(0, &server);
+  release(&lwip_lock);
+}
+
+// Use the DNS server at addr, in network byte order, from
+// now on; for testing against a local server.
+void
+resolvserver(uint32 addr)
+{
+  ip_addr_t server = { .addr = addr };
+
+  acquire(&lwip_lock);
+  dns_setserver(0, &server);
+  release(&lwip_lock);
+
+  // failures were the old server's.
+  acquire(&dnslock);
+  memset(dnsneg, 0, sizeof(dnsneg));
+  release(&dnslock);
+}
+
+// Is name in the negative cache? Caller holds dnslock.
+static int
+negcached(char *name)
+{
+  for(int i = 0; i < NDNSNEG; i++){
+    if(dnsneg[i].name[0] == 0)
+      continue;
+    if((int)(dnsneg[i].expire - sys_now()) <= 0)
+      dnsneg[i].name[0] = 0;
+    else if(strncmp(dnsneg[i].name, name, MAX_DOMAIN_NAME) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// Remember that name failed, in place of the entry that
+// expires first. Caller holds dnslock.
+static void
+negadd(char *name)
+{
+  int i, victim = 0;
+
+  for(i = 0; i < NDNSNEG; i++){
+    if(dnsneg[i].name[0] == 0){
+      victim = i;
+      break;
+    }
+    if((int)(dnsneg[i].expire - dnsneg[victim].expire) < 0)
+      victim = i;
+  }
+  safestrcpy(dnsneg[victim].name, name, MAX_DOMAIN_NAME);
+  dnsneg[victim].expire = sys_now() + NEGTTL;
+}
+
+// drop a reference to r. caller holds dnslock.
+static void
+dnsput(struct dnsreq *r)
+{
+  if(--r->ref == 0)
+    r->state = DNS_FREE;
+}
+
+// lwIP's callback when a query is answered or gives up.
+static void
+dnsfound(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+  struct dnsreq *r = arg;
+
+  acquire(&dnslock);
+  if(ipaddr){
+    r->addr = ipaddr->addr;
+    r->state = DNS_DONE;
+  } else {
+    negadd(r->name);
+    r->state = DNS_FAILED;
+  }
+  wakeup(r);
+  dnsput(r);
+  release(&dnslock);
+
+  sock_poll_wakeup();
+}
+
+// Start looking up name. Returns the lookup, which may be done
+// already, or 0 if there are too many.
+struct dnsreq*
+dnsstart(char *name)
+{
+  struct dnsreq *r;
+  ip_addr_t ipaddr;
+  uint32 dst;
+  err_t err;
+
+  acquire(&dnslock);
+  for(r = dnsreqs; r < &dnsreqs[NDNSREQ]; r++)
+    if(r->state == DNS_FREE)
+      break;
+  if(r == &dnsreqs[NDNSREQ]){
+    release(&dnslock);
+    return 0;
+  }
+  r->ref = 1;
+  r->addr = 0;
+  safestrcpy(r->name, name, MAX_DOMAIN_NAME);
+  if(negcached(r->name)){
+    r->state = DNS_FAILED;
+    release(&dnslock);
+    return r;
+  }
+  r->state = DNS_PENDING;
+  r->ref++;  // for dnsfound()
+  release(&dnslock);
+
+  // queries need an address to come back to, unless they stay
+  // on loopback: a numeric loopback name, or a server on this host.
+  acquire(&lwip_lock);
+  dst = ip_addr_get_ip4_u32(dns_getserver(0));
+  release(&lwip_lock);
+  if(ip4addr_aton(r->name, &ipaddr))
+    dst = ipaddr.addr;
+  if(netwait(dst) < 0){
+    err = ERR_IF;
+  } else {
+    acquire(&lwip_lock);
+    err = dns_gethostbyname(r->name, &ipaddr, dnsfound, r);
+    release(&lwip_lock);
+  }
+  if(err == ERR_INPROGRESS)
+    return r;
+
+  // answered from the cache, or not sent at all.
+  acquire(&dnslock);
+  if(err == ERR_OK){
+    r->addr = ipaddr.addr;
+    r->state = DNS_DONE;
+  } else {
+    r->state = DNS_FAILED;
+  }
+  dnsput(r);
+  release(&dnslock);
+  return r;
+}
+
+// Wait for r to finish, unless nonblocking. Sets *addr and
+// returns 0 if the name resolved, returns 1 if it did not,
+// or -1 if r is still pending or the caller was killed.
+int
+dnswait(struct dnsreq *r, int nonblocking, uint32 *addr)
+{
+  struct proc *p = myproc();
+  int rc;
+
+  acquire(&dnslock);
+  while(r->state == DNS_PENDING){
+    if(nonblocking){
+      release(&dnslock);
+      p->error_no = EAGAIN;
+      return -1;
+    }
+    if(p->killed){
+      release(&dnslock);
+      return -1;
+    }
+    sleep(r, &dnslock);
+  }
+  rc = r->state == DNS_DONE ? 0 : 1;
+  *addr = r->addr;
+  release(&dnslock);
+  return rc;
+}
+
+// Is r finished? For net_poll().
+int
+dnsready(struct dnsreq *r)
+{
+  return r->state != DNS_PENDING;
+}
+
+// read() of a resolve() descriptor: the 4-byte address, or
+// 0 bytes if the name did not resolve.
+int
+dnsread(struct dnsreq *r, uint64 addr, int n, int nonblocking)
+{
+  uint32 a;
+  int rc;
+
+  if(n < sizeof(a))
+    return -1;
+  if((rc = dnswait(r, nonblocking, &a)) != 0)
+    return rc < 0 ? -1 : 0;
+  if(copyout(myproc()->pagetable, addr, (char*)&a, sizeof(a)) < 0)
+    return -1;
+  return sizeof(a);
+}
+
+void
+dnsclose(struct dnsreq *r)
+{
+  acquire(&dnslock);
+  dnsput(r);
+  release(&dnslock);
+}
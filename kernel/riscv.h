@@ -260,6 +260,35 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor-mode Counter-Enable
+// bits: 0 cycle, 1 time, 2 instret.
+#define COUNTEREN_CY (1L << 0)
+#define COUNTEREN_TM (1L << 1)
+#define COUNTEREN_IR (1L << 2)
+
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
+// processor cycle counter
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -351,6 +380,7 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_TEXT (1L << 8) // software: shared page of a program image
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,210 @@
+// Shared-memory segments.
+//
+// shmget() finds or creates a segment of zeroed pages by key,
+// and shmat() maps a segment into the caller's address space
+// at one of the NSHMAT SHMVA() slots below the thread frames.
+// Every process that attaches a segment maps the same physical
+// pages, so data written by one is visible to all of them
+// without a system call or a copy. fork() children inherit
+// their parent's attachments.
+//
+// A segment counts the address spaces it is attached to, and
+// its pages are freed when the last one detaches, by shmdt(),
+// exit(), or exec(). A segment that was never attached stays
+// until it is.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct shm {
+  int key;                     // shmget() key, or 0 if private
+  int used;                    // slot in use
+  int ref;                     // address spaces attached
+  int npages;
+  char *pages[SHMMAXPG];
+};
+
+// lock order: vm->lock, then shmlock.
+static struct spinlock shmlock;
+static struct shm shm[NSHM];
+
+void
+shminit(void)
+{
+  initlock(&shmlock, "shm");
+}
+
+// free s's pages. caller holds shmlock.
+static void
+shmfree(struct shm *s)
+{
+  for(int i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+  s->used = 0;
+  s->key = 0;
+}
+
+// Return the id of the segment with the given key, creating
+// it with size bytes if there is none. Key 0 always creates
+// a new segment. Returns -1 if the key exists but is smaller
+// than size, or if there is no room.
+int
+shmget(int key, int size)
+{
+  struct shm *s, *free = 0;
+  int n;
+
+  if(size <= 0 || size > SHMMAXPG*PGSIZE)
+    return -1;
+  n = PGROUNDUP(size) / PGSIZE;
+
+  acquire(&shmlock);
+  for(s = shm; s < &shm[NSHM]; s++){
+    if(s->used && key != 0 && s->key == key){
+      release(&shmlock);
+      return s->npages < n ? -1 : s - shm;
+    }
+    if(!s->used && free == 0)
+      free = s;
+  }
+  if((s = free) == 0){
+    release(&shmlock);
+    return -1;
+  }
+  s->used = 1;
+  s->key = key;
+  s->ref = 0;
+  for(s->npages = 0; s->npages < n; s->npages++){
+    if((s->pages[s->npages] = kalloc()) == 0){
+      shmfree(s);
+      release(&shmlock);
+      return -1;
+    }
+    memset(s->pages[s->npages], 0, PGSIZE);
+  }
+  release(&shmlock);
+  return s - shm;
+}
+
+// map s into vm's slot i. caller holds vm->lock and shmlock.
+static int
+shmmap(struct vmspace *vm, int i, struct shm *s)
+{
+  for(int j = 0; j < s->npages; j++){
+    if(mappages(vm->pagetable, SHMVA(i) + j*PGSIZE, PGSIZE,
+                (uint64)s->pages[j], PTE_R | PTE_W | PTE_U) < 0){
+      if(j > 0)
+        uvmunmap(vm->pagetable, SHMVA(i), j*PGSIZE, 0);
+      return -1;
+    }
+  }
+  vm->shm[i] = s;
+  s->ref++;
+  return 0;
+}
+
+// unmap vm's slot i, freeing the segment if it was the last
+// attachment. caller holds vm->lock and shmlock.
+static void
+shmunmap(struct vmspace *vm, int i)
+{
+  struct shm *s = vm->shm[i];
+
+  uvmunmap(vm->pagetable, SHMVA(i), s->npages*PGSIZE, 0);
+  vm->shm[i] = 0;
+  if(--s->ref == 0)
+    shmfree(s);
+}
+
+// Attach segment id to the current process.
+// Returns the user address it is mapped at, or -1.
+uint64
+shmat(int id)
+{
+  struct vmspace *vm = myproc()->vm;
+  struct shm *s;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shm[id];
+
+  acquire(&vm->lock);
+  acquire(&shmlock);
+  for(i = 0; i < NSHMAT; i++)
+    if(vm->shm[i] == 0)
+      break;
+  if(!s->used || i == NSHMAT || shmmap(vm, i, s) < 0){
+    release(&shmlock);
+    release(&vm->lock);
+    return -1;
+  }
+  release(&shmlock);
+  release(&vm->lock);
+  return SHMVA(i);
+}
+
+// Detach the segment shmat() mapped at addr.
+int
+shmdt(uint64 addr)
+{
+  struct vmspace *vm = myproc()->vm;
+  int i;
+
+  for(i = 0; i < NSHMAT; i++)
+    if(addr == SHMVA(i))
+      break;
+  if(i == NSHMAT)
+    return -1;
+
+  acquire(&vm->lock);
+  // like shrinking memory, unmapping pages that sibling
+  // threads may still have in their TLBs is not safe.
+  if(vm->shm[i] == 0 || vm->ref > 1){
+    release(&vm->lock);
+    return -1;
+  }
+  acquire(&shmlock);
+  shmunmap(vm, i);
+  release(&shmlock);
+  release(&vm->lock);
+  return 0;
+}
+
+// Attach everything attached to from to the new address
+// space to as well, for fork(). Returns 0 or -1.
+int
+shmfork(struct vmspace *from, struct vmspace *to)
+{
+  int i, r = 0;
+
+  acquire(&from->lock);
+  acquire(&shmlock);
+  for(i = 0; i < NSHMAT; i++){
+    if(from->shm[i] && shmmap(to, i, from->shm[i]) < 0){
+      r = -1;
+      break;
+    }
+  }
+  release(&shmlock);
+  release(&from->lock);
+  return r;
+}
+
+// Detach everything from vm before its page table is freed.
+// Caller holds vm->lock.
+void
+shmdetachall(struct vmspace *vm)
+{
+  acquire(&shmlock);
+  for(int i = 0; i < NSHMAT; i++)
+    if(vm->shm[i])
+      shmunmap(vm, i);
+  release(&shmlock);
+}
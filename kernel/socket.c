@@ -8,35 +8,50 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "socklat.h"
 #include "socket.h"
+#include "netstat.h"
 #include "lwip/tcp.h"
-#include "lwip/dns.h"
+#include "lwip/udp.h"
 #include "lwip/debug.h"
 #include "lwip/inet.h"
 
 struct socket sockets[NSOCK];
 
-struct {
-    struct spinlock lock;
-    int sem;
-} dns_sem;
+// a full segment must fit in an empty ring, or every one is held back
+_Static_assert(RECV_BUFLEN >= TCP_MSS, "RECV_BUFLEN smaller than TCP_MSS");
+_Static_assert(DGRAMPG * PGSIZE >= MAXDGRAM, "DGRAMPG assumes 4096-byte pages");
 
 // Global channel for net_poll wakeup
 struct {
     struct spinlock lock;
     int waiting;            // Number of processes waiting on poll
+    int timed;              // How many of those have a timeout
 } net_poll_chan;
 
+// times sock_recv() held data back for lack of ring buffer space
+static uint64 recv_errmem;
+
+extern struct spinlock lwip_lock;
+
+// Count the time since t0 in stage of sock's latency histogram.
+static void latrecord(struct socket *sock, int stage, uint64 t0)
+{
+    uint64 d = r_mtime() - t0;
+    int b;
+
+    for (b = 0; d != 0 && b < NLATBUCKET - 1; b++)
+        d >>= 1;
+    sock->lat.n[stage][b]++;
+}
+
 // initialize socket module, called from main.c
 void sockinit(void)
 {
-    // initialize the global DNS semaphore
-    initlock(&dns_sem.lock, "dns");
-    dns_sem.sem = 0;
-    
     // initialize the net_poll channel
     initlock(&net_poll_chan.lock, "net_poll");
     net_poll_chan.waiting = 0;
+    net_poll_chan.timed = 0;
 }
 
 static void sem_wait(struct spinlock *lock, int *sem)
@@ -53,7 +68,9 @@ static void sem_signal(struct spinlock *lock, int *sem)
 {
     acquire(lock);
     *sem = 1;
-    wakeup(sem);
+    // socket callbacks run on the CPU that handled the packet;
+    // let the reader run there too.
+    wakeuplocal(sem);
     release(lock);
 }
 
@@ -61,6 +78,39 @@ static void sem_signal(struct spinlock *lock, int *sem)
 /* CALLBACK FUNCTIONS */
 
 
+// Copy what fits of pbuf chain p into sock's receive ring, in two
+// pieces if it wraps; returns the number of bytes copied.
+static int sock_ringput(struct socket *sock, struct pbuf *p)
+{
+    int space = RECV_BUFLEN - (sock->recv_avail - sock->recv_used + 1);
+    int n = p->tot_len < space ? p->tot_len : space;
+    int start = (sock->recv_avail + 1) % RECV_BUFLEN;
+    int len1 = RECV_BUFLEN - start < n ? RECV_BUFLEN - start : n;
+
+    pbuf_copy_partial(p, sock->recv_buf + start, len1, 0);
+    pbuf_copy_partial(p, sock->recv_buf, n - len1, len1);
+    sock->recv_avail += n;
+    sock->bytes_in += n;
+    return n;
+}
+
+// Move held-back data into the ring, as far as it has room.
+static void sock_fill(struct socket *sock)
+{
+    int n;
+
+    acquire(&lwip_lock);
+    if (sock->recv_pend) {
+        if (sock->recv_avail - sock->recv_used + 1 == 0)
+            sock->t_recv = r_mtime();
+        if ((n = sock_ringput(sock, sock->recv_pend)) > 0) {
+            sock->recv_pend = pbuf_free_header(sock->recv_pend, n);
+            tcp_recved(sock->pcb, n);
+        }
+    }
+    release(&lwip_lock);
+}
+
 err_t sock_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
     struct socket *sock = (struct socket *)arg;
@@ -69,40 +119,44 @@ err_t sock_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
     if (p == NULL) {
         sock->eof_reached = 1;
         printf("sock_recv: received EOF\n");
+        sock->t_signal = r_mtime();
         sem_signal(&sock->lock, &sock->recv_sem);
         sock_poll_wakeup();  // Wake up poll waiters
         return ERR_OK;
     }
     
-    // if p->len is larger than the available space in the ring buffer, store the packet for later
-    int avail_space = RECV_BUFLEN - (sock->recv_avail - sock->recv_used + 1);
-    if (p->len > avail_space) {
-        printf("sock_recv: no sufficient space in recv_buf\n");
-        printf("sock_recv: p->len = %d, avail_space = %d\n", p->len, avail_space);
-        return ERR_MEM;  // data will be stored in lwip's internal buffer
-    }
-    
-    // copy data from pbuf to socket ring buffer
-    int avail_ptr = sock->recv_avail % RECV_BUFLEN;
-    if (avail_ptr + p->len >= RECV_BUFLEN) {
-        int len1 = RECV_BUFLEN - avail_ptr - 1;
-        int len2 = p->len - len1;
-        memmove(sock->recv_buf + avail_ptr + 1, p->payload, len1);
-        memmove(sock->recv_buf, p->payload + len1, len2);
+    // lwIP holds the segment, or the chain GRO merged from several,
+    // until we return. Whatever does not fit in the ring waits in
+    // recv_pend, behind anything already there, until sockread()
+    // makes room; the window opens only as bytes enter the ring.
+    if (sock->recv_pend) {
+        pbuf_cat(sock->recv_pend, p);
+        recv_errmem++;
     } else {
-        memmove(sock->recv_buf + avail_ptr + 1, p->payload, p->len);
-    }
-    sock->recv_avail += p->len;
-
-    printf("sock_recv: read %d bytes\n", p->len);
+        // time spent in lwIP since the driver handed the frame over;
+        // 0 when lwIP delivers data it had held back earlier.
+        uint64 t_rx = netrxtime();
+        if (t_rx)
+            latrecord(sock, LAT_LWIPRX, t_rx);
+        if (sock->recv_avail - sock->recv_used + 1 == 0)
+            sock->t_recv = r_mtime();
+
+        int n = sock_ringput(sock, p);
+        if (n < p->tot_len) {
+            sock->recv_pend = pbuf_free_header(p, n);
+            recv_errmem++;
+        } else {
+            pbuf_free(p);
+        }
 
-    // inform lwip that we have read some data
-    tcp_recved(sock->pcb, p->tot_len);
-    
-    // free the pbuf
-    pbuf_free(p);
+        // inform lwip that we have read some data
+        if (n > 0)
+            tcp_recved(sock->pcb, n);
+    }
 
-    // signal the socket
+    // signal the socket, held-back data too: sockread() moves
+    // it into the ring if the ring has drained meanwhile.
+    sock->t_last = sock->t_signal = r_mtime();
     sem_signal(&sock->lock, &sock->recv_sem);
     
     // Wake up poll waiters
@@ -117,6 +171,10 @@ err_t sock_sent(void *arg, struct tcp_pcb *tpcb, u16_t len)
     struct socket *sock = (struct socket *)arg;
     
     sock->sent_len += len;
+    if (sock->t_output) {
+        latrecord(sock, LAT_ACK, sock->t_output);
+        sock->t_output = 0;
+    }
 
     printf("sock_sent: sent %d bytes, waking up process\n", len);
 
@@ -193,7 +251,8 @@ err_t sock_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
         inet_ntoa(newpcb->remote_ip), newpcb->remote_port);
 
     // allocate a new socket for the new connection
-    int newsockfd = sockalloc(sock->domain, sock->type, sock->protocol, newpcb, sock->owner);
+    struct socket *newsock;
+    int newsockfd = sockalloc(sock->domain, sock->type, sock->protocol, newpcb, sock->owner, &newsock);
     if (newsockfd < 0) {
         printf("sock_accept: failed to allocate new socket, aborting connection\n");
         tcp_abort(newpcb);
@@ -202,7 +261,6 @@ err_t sock_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
     printf("new socket allocated: %d\n", newsockfd);
 
     // set up callbacks for the new socket
-    struct socket *newsock = sock->owner->ofile[newsockfd]->sock;
     newsock->state = SS_CONNECTED;
     sock_setup_callbacks(newsock);
 
@@ -224,24 +282,32 @@ err_t sock_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
     return ERR_OK;
 }
 
-// callback function called when a hostname is found or an error occurs (failure/timeout)
-void sock_dns_found(const char *name, const ip_addr_t *ipaddr, void *callback_arg)
+// callback function called when a datagram arrives for a UDP socket
+// the datagram is copied out so that lwIP's few pbufs are not held
+void sock_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
-    ip_addr_t *addr = (ip_addr_t *)callback_arg;
+    struct socket *sock = (struct socket *)arg;
 
-    if (ipaddr == NULL) {
-        printf("sock_dns_found: failed to resolve hostname %s\n", name);
-        sem_signal(&dns_sem.lock, &dns_sem.sem);
-        return;
+    acquire(&sock->lock);
+    if (sock->dgram_tail - sock->dgram_head == NDGRAM) {
+        sock->dgram_drops++;
+    } else {
+        // longer datagrams are truncated, as recvfrom() would anyway
+        struct dgram *d = &sock->dgram[sock->dgram_tail % NDGRAM];
+        d->len = LWIP_MIN(p->tot_len, MAXDGRAM);
+        for (int k = 0; k * PGSIZE < d->len; k++)
+            pbuf_copy_partial(p, d->data[k], LWIP_MIN(d->len - k * PGSIZE, PGSIZE), k * PGSIZE);
+        d->addr = ip_addr_get_ip4_u32(addr);
+        d->port = htons(port);
+        sock->dgram_tail++;
+        sock->bytes_in += d->len;
+        sock->t_signal = r_mtime();
+        wakeuplocal(&sock->recv_sem);
     }
+    release(&sock->lock);
+    pbuf_free(p);
 
-    // return the resolved IP address
-    addr->addr = ipaddr->addr;
-
-    printf("sock_dns_found: resolved hostname %s to %s\n", name, ipaddr_ntoa(ipaddr));
-
-    // wake up the process that called gethostbyname()
-    sem_signal(&dns_sem.lock, &dns_sem.sem);
+    sock_poll_wakeup();
 }
 
 static void sock_setup_callbacks(struct socket *sock)
@@ -278,9 +344,14 @@ static int initsock(struct socket *sock)
     sock->accept_pcb = NULL;
     sock->accept_fd = -1;
 
+    sock->sent_len = 0;
+    sock->bytes_in = 0;
+    sock->bytes_out = 0;
+
     // ring buffer for received data
     sock->recv_avail = -1;
     sock->recv_used = 0;
+    sock->recv_pend = NULL;
     sock->eof_reached = 0;
 
     sock->owner = NULL;
@@ -291,15 +362,71 @@ static int initsock(struct socket *sock)
     sock->sem = 0;
     sock->recv_sem = 0;
 
+    sock->t_recv = 0;
+    sock->t_signal = 0;
+    sock->t_last = 0;
+    sock->t_output = 0;
+    memset(&sock->lat, 0, sizeof(sock->lat));
+
+    sock->upcb = NULL;
+    memset(sock->dgram, 0, sizeof(sock->dgram));
+    sock->dgram_head = 0;
+    sock->dgram_tail = 0;
+    sock->dgram_drops = 0;
+
+    sock->rx = NULL;
+    sock->tx = NULL;
+    sock->path[0] = 0;
+
+    return 0;
+}
+
+// set up the pcb and datagram queue of a new UDP socket
+// returns 0 on success, or -1 on error
+static int initdgram(struct socket *sock)
+{
+    for (int i = 0; i < NDGRAM; i++) {
+        for (int k = 0; k < DGRAMPG; k++) {
+            if ((sock->dgram[i].data[k] = kalloc()) == NULL)
+                return -1;
+        }
+    }
+    if ((sock->upcb = udp_new()) == NULL)
+        return -1;
+    udp_recv(sock->upcb, sock_udp_recv, sock);
     return 0;
 }
 
+// undo initdgram()
+static void freedgram(struct socket *sock)
+{
+    if (sock->upcb != NULL) {
+        udp_remove(sock->upcb);
+        sock->upcb = NULL;
+    }
+    for (int i = 0; i < NDGRAM; i++) {
+        for (int k = 0; k < DGRAMPG; k++) {
+            if (sock->dgram[i].data[k] != NULL)
+                kfree(sock->dgram[i].data[k]);
+            sock->dgram[i].data[k] = NULL;
+        }
+    }
+}
+
 // called from sys_socket() in kernel/sysfile.c
 // https://man7.org/linux/man-pages/man2/socket.2.html
-// returns a file descriptor on success, or -1 on error
-int sockalloc(int domain, int type, int protocol, struct tcp_pcb *pcb, struct proc *p) {
-    LWIP_ASSERT("sockalloc: invalid domain", domain == AF_INET);
-    LWIP_ASSERT("sockalloc: invalid type", type == SOCK_STREAM);
+// returns a file descriptor on success, or -1 on error; the socket
+// goes in *sockp if sockp is not NULL, since once fd is in p's table
+// a thread of p may close it.
+int sockalloc(int domain, int type, int protocol, struct tcp_pcb *pcb, struct proc *p, struct socket **sockp) {
+    if (domain != AF_INET && domain != AF_UNIX) {
+        printf("sockalloc: invalid domain %d\n", domain);
+        return -1;
+    }
+    if (type != SOCK_STREAM && (type != SOCK_DGRAM || domain == AF_UNIX)) {
+        printf("sockalloc: invalid type %d\n", type);
+        return -1;
+    }
     LWIP_ASSERT("sockalloc: invalid protocol", protocol == 0);  // TODO: make this an enum: IPPROTO_TCP
 
     // allocate a free socket
@@ -319,22 +446,45 @@ int sockalloc(int domain, int type, int protocol, struct tcp_pcb *pcb, struct pr
     s->domain = domain;
     s->type = type;
     s->protocol = protocol;
-    s->pcb = pcb == NULL ? tcp_new() : pcb;
     s->owner = p == NULL ? myproc() : p;
+    if (type == SOCK_DGRAM) {
+        if (initdgram(s) < 0) {
+            printf("sockalloc: no memory for a UDP socket\n");
+            freedgram(s);
+            s->state = SS_FREE;
+            return -1;
+        }
+    } else if (domain == AF_INET) {
+        s->pcb = pcb == NULL ? tcp_new() : pcb;
+    }
 
-    // allocate a fd for the socket
+    // allocate a fd for the socket; the file must be complete
+    // before it is in the table, where other threads can use it.
     struct file *f = filealloc();
-    int fd = fdalloc_for_proc(f, s->owner);
+    int fd = -1;
+    if (f) {
+        f->type = FD_SOCK;
+        f->sock = s;
+        f->readable = 1;
+        f->writable = 1;
+        s->file = f;
+        fd = fdalloc_for_proc(f, s->owner);
+    }
     if (fd < 0) {
         printf("sockalloc: no free fd\n");
+        if (f) {
+            f->type = FD_NONE;
+            fileclose(f);
+        }
+        if (type == SOCK_DGRAM) {
+            freedgram(s);
+            s->state = SS_FREE;
+        }
         return -1;
     }
-    f->type = FD_SOCK;
-    f->sock = s;
-    f->readable = 1;
-    f->writable = 1;
-    s->file = f;
     s->fd = fd;
+    if (sockp)
+        *sockp = s;
 
     return fd;
 }
@@ -344,20 +494,28 @@ int sockalloc(int domain, int type, int protocol, struct tcp_pcb *pcb, struct pr
 // returns the number of bytes read on success, or -1 on error
 int sockread(struct socket *sock, uint64 addr, int n, char nonblocking) 
 {
+    if (sock->domain == AF_UNIX)
+        return unixread(sock, addr, n, nonblocking);
+    if (sock->type == SOCK_DGRAM)
+        return sockrecvfrom(sock, addr, n, NULL, nonblocking);
+
     LWIP_ASSERT("sockread: invalid socket state", sock->state == SS_CONNECTED);
 
+    // data held back for lack of room counts as available
+    sock_fill(sock);
+
     // save recv_avail in case it is changed by the scheduler thread
     // no need to save recv_used because it is only changed by this thread
     int recv_avail = sock->recv_avail;
     int num_avail = recv_avail - sock->recv_used + 1;
-    
-    // EOF received and all data has been read
-    // returning 0 indicates EOF to the user application
-    if (sock->eof_reached && num_avail == 0)
-        return 0;
 
     // No data available
-    if (num_avail == 0) {
+    while (num_avail == 0) {
+        // EOF received and all data has been read
+        // returning 0 indicates EOF to the user application
+        if (sock->eof_reached)
+            return 0;
+
         // In non-blocking mode, return EAGAIN immediately
         if (nonblocking) {
             myproc()->error_no = EAGAIN;
@@ -370,16 +528,18 @@ int sockread(struct socket *sock, uint64 addr, int n, char nonblocking)
 
         printf("sockread: waiting for some data\n");
         sem_wait(&sock->lock, &sock->recv_sem);
+        if (sock->t_signal) {
+            latrecord(sock, LAT_WAKEUP, sock->t_signal);
+            sock->t_signal = 0;
+        }
 
         sock->state = SS_CONNECTED;
 
-        // some data is available or EOF is received
-        // read in updated recv_avail
+        // some data is available, possibly held back, or EOF is
+        // received; the signal may also be left over from data
+        // already read, so look again.
+        sock_fill(sock);
         num_avail = sock->recv_avail - sock->recv_used + 1;
-
-        // no new data is available, so EOF is received
-        if (num_avail == 0)
-            return 0;
     }
 
     // copy data from socket ring buffer to user buffer
@@ -405,6 +565,15 @@ int sockread(struct socket *sock, uint64 addr, int n, char nonblocking)
 
     // update recv_used pointer
     sock->recv_used += to_read;
+    sock_fill(sock);
+
+    // how long the oldest of this data waited in the ring;
+    // whatever is left arrived by the last sock_recv() at the latest.
+    if (sock->t_recv) {
+        latrecord(sock, LAT_RING, sock->t_recv);
+        sock->t_recv = sock->recv_avail - sock->recv_used + 1 > 0 ? sock->t_last : 0;
+    }
+    myproc()->lastread = r_mtime();
 
     return to_read;
 }
@@ -414,6 +583,11 @@ int sockread(struct socket *sock, uint64 addr, int n, char nonblocking)
 // returns the number of bytes written on success, or -1 on error
 int sockwrite(struct socket *sock, uint64 addr, int n, char nonblocking) 
 {
+    if (sock->domain == AF_UNIX)
+        return unixwrite(sock, addr, n, nonblocking);
+    if (sock->type == SOCK_DGRAM)
+        return socksendto(sock, addr, n, NULL);
+
     LWIP_ASSERT("sockwrite: invalid socket state", sock->state == SS_CONNECTED);
 
     // copy data from user space to kernel space
@@ -431,6 +605,13 @@ int sockwrite(struct socket *sock, uint64 addr, int n, char nonblocking)
     // we do not zero this out when the send buffer is emptied
     int sent_len_old = sock->sent_len;
 
+    // time the application took since its last read
+    uint64 t_write = r_mtime();
+    if (myproc()->lastread) {
+        latrecord(sock, LAT_APP, myproc()->lastread);
+        myproc()->lastread = 0;
+    }
+
     // send data
     int sent_len = 0;
     int written_len = 0;
@@ -493,6 +674,7 @@ int sockwrite(struct socket *sock, uint64 addr, int n, char nonblocking)
 
             // successfully written to send buffer
             written_len += to_write_len;
+            sock->bytes_out += to_write_len;
             break;
         }
     }
@@ -503,6 +685,9 @@ int sockwrite(struct socket *sock, uint64 addr, int n, char nonblocking)
         printf("sockwrite: tcp_output failed\n");
         return sent_len;
     }
+    latrecord(sock, LAT_TX, t_write);
+    if (sock->t_output == 0)
+        sock->t_output = r_mtime();
 
     // will be woken up by sock_sent() when some data has been acknowledged
     // TODO: wake this process up in tcp_poll in case of missed wakeup
@@ -518,9 +703,81 @@ int sockwrite(struct socket *sock, uint64 addr, int n, char nonblocking)
     return n;
 }
 
+// pipeconsume() sink for socksplice(): queue a run of pipe
+// bytes on the connection, as much as its send buffer takes.
+static int splicesink(void *arg, char *p, int n)
+{
+    struct socket *sock = (struct socket *)arg;
+    int avail = tcp_sndbuf(sock->pcb);
+
+    if (n > avail)
+        n = avail;
+    if (n == 0 || tcp_write(sock->pcb, p, n, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK)
+        return 0;
+    sock->bytes_out += n;
+    return n;
+}
+
+// Move up to n bytes from pipe pi to sock without a trip
+// through user space: lwIP copies straight out of the pipe's
+// pages. Waits for the pipe to have data, then moves what it
+// can. Returns the number of bytes moved, 0 at end of file,
+// or -1.
+int socksplice(struct socket *sock, struct pipe *pi, int n)
+{
+    if (sock->domain != AF_INET || sock->type != SOCK_STREAM || sock->state != SS_CONNECTED)
+        return -1;
+
+    int sent_len_old = sock->sent_len;
+    int moved = 0;
+
+    while (moved < n) {
+        int r = pipeconsume(pi, n - moved, moved > 0, splicesink, sock);
+        if (r < 0)
+            return moved > 0 ? moved : -1;
+        if (r == 0) {
+            // a short splice is fine once something moved.
+            if (moved > 0 || pipeeof(pi))
+                break;
+            // the send queue is full: wait for the peer to ack.
+            if (tcp_output(sock->pcb) != ERR_OK)
+                return -1;
+            sem_wait(&sock->lock, &sock->sem);
+            continue;
+        }
+        moved += r;
+    }
+    if (moved == 0)
+        return 0;
+
+    if (tcp_output(sock->pcb) != ERR_OK)
+        return -1;
+    if (sock->t_output == 0)
+        sock->t_output = r_mtime();
+
+    // like sockwrite(), return once the peer has it all, so
+    // that sock->sem is not left set for the next write.
+    while (sock->sent_len - sent_len_old < moved)
+        sem_wait(&sock->lock, &sock->sem);
+    return moved;
+}
+
 // called from fileclose() in kernel/file.c
 void sockclose(struct socket *sock)
 {
+    if (sock->domain == AF_UNIX) {
+        unixclose(sock);
+        return;
+    }
+    // the descriptor is gone from the table already: the last
+    // reference may be dropped by another thread, after fd was
+    // reused, or by a process that inherited the file.
+    if (sock->type == SOCK_DGRAM) {
+        freedgram(sock);
+        sock->state = SS_FREE;
+        return;
+    }
+
     // socket could be in any state
 
     // unset callbacks
@@ -530,9 +787,6 @@ void sockclose(struct socket *sock)
     tcp_poll(sock->pcb, NULL, 0);
     tcp_accept(sock->pcb,NULL);
 
-    // free file descriptor
-    myproc()->ofile[sock->fd] = 0;
-    
     // TODO: The function may return ERR_MEM if no memory 
     // was available for closing the connection. 
     // If so, the application should wait and try again 
@@ -545,6 +799,13 @@ void sockclose(struct socket *sock)
         printf("sockclose: tcp_close failed\n");
     }
 
+    if (sock->recv_pend) {
+        acquire(&lwip_lock);
+        pbuf_free(sock->recv_pend);
+        release(&lwip_lock);
+        sock->recv_pend = NULL;
+    }
+
     // free socket
     sock->state = SS_FREE;
     sock->pcb = NULL;   // should not be referenced anymore after tcp_close()
@@ -557,13 +818,23 @@ void sockclose(struct socket *sock)
 // called from sys_connect() in kernel/sysfile.c
 // https://man7.org/linux/man-pages/man2/connect.2.html
 // returns 0 on success, or -1 on error
-int sockconnect(int sockfd, const struct sockaddr *addr, int addrlen) 
+int sockconnect(struct socket *sock, const struct sockaddr *addr, int addrlen) 
 {
-    struct socket *sock = myproc()->ofile[sockfd]->sock;
     if (sock == NULL) {
         printf("sockconnect: invalid socket\n");
         return -1;
     }
+    if (sock->domain != AF_INET || addr->sa_family != AF_INET)
+        return -1;  // AF_UNIX goes to unixconnect()
+
+    // a UDP socket just records its default peer
+    if (sock->type == SOCK_DGRAM) {
+        ip_addr_t ipaddr = {addr->sin_addr};
+        if (udp_connect(sock->upcb, &ipaddr, ntohs(addr->sin_port)) != ERR_OK)
+            return -1;
+        sock->state = SS_CONNECTED;
+        return 0;
+    }
     
     // set socket state from SS_UNCONNECTED to SS_CONNECTING
     LWIP_ASSERT("sockconnect: invalid socket state", sock->state == SS_UNCONNECTED);
@@ -571,6 +842,12 @@ int sockconnect(int sockfd, const struct sockaddr *addr, int addrlen)
     
     sock_setup_callbacks(sock);
 
+    // DHCP may still be running; do not connect from 0.0.0.0
+    if (netwait(addr->sin_addr) < 0) {
+        sock->state = SS_UNCONNECTED;
+        return -1;
+    }
+
     ip_addr_t ipaddr = {addr->sin_addr};
     err_t err = tcp_connect(sock->pcb, &ipaddr, ntohs(addr->sin_port), sock_connected);
     if (err != ERR_OK) {
@@ -597,13 +874,14 @@ int sockconnect(int sockfd, const struct sockaddr *addr, int addrlen)
 // called from sys_bind() in kernel/sysfile.c
 // https://man7.org/linux/man-pages/man2/bind.2.html
 // returns 0 on success, or -1 on error
-int sockbind(int sockfd, const struct sockaddr *addr, int addrlen)
+int sockbind(struct socket *sock, const struct sockaddr *addr, int addrlen)
 {
-    struct socket *sock = myproc()->ofile[sockfd]->sock;
     if (sock == NULL) {
         printf("sockbind: invalid socket\n");
         return -1;
     }
+    if (sock->domain != AF_INET)
+        return -1;  // AF_UNIX goes to unixbind()
 
     LWIP_ASSERT("sockbind: invalid socket state", sock->state == SS_UNCONNECTED);
     LWIP_ASSERT("sockbind: invalid address family", addr->sa_family == AF_INET);
@@ -611,14 +889,18 @@ int sockbind(int sockfd, const struct sockaddr *addr, int addrlen)
     // bind socket to port
     ip_addr_t ipaddr = {addr->sin_addr};
 
-    err_t err = tcp_bind(sock->pcb, &ipaddr, addr->sin_port);
+    err_t err;
+    if (sock->type == SOCK_DGRAM)
+        err = udp_bind(sock->upcb, &ipaddr, addr->sin_port);
+    else
+        err = tcp_bind(sock->pcb, &ipaddr, addr->sin_port);
 
     if (err == ERR_USE) {
         printf("sockbind: port %d already in use\n", addr->sin_port);
         return -1;
     }
     if (err != ERR_OK) {  // other errors
-        printf("sockbind: tcp_bind failed\n");
+        printf("sockbind: bind failed\n");
         return -1;
     }
 
@@ -629,13 +911,16 @@ int sockbind(int sockfd, const struct sockaddr *addr, int addrlen)
 // https://man7.org/linux/man-pages/man2/listen.2.html
 // enable backlog for the socket: set TCP_LISTEN_BACKLOG=1 in lwipopts.h
 // returns 0 on success, or -1 on error
-int socklisten(int sockfd, int backlog)
+int socklisten(struct socket *sock, int backlog)
 {
-    struct socket *sock = myproc()->ofile[sockfd]->sock;
     if (sock == NULL) {
         printf("socklisten: invalid socket\n");
         return -1;
     }
+    if (sock->type != SOCK_STREAM)
+        return -1;
+    if (sock->domain == AF_UNIX)
+        return unixlisten(sock);
 
     LWIP_ASSERT("socklisten: invalid socket state", sock->state == SS_UNCONNECTED);
 
@@ -666,13 +951,16 @@ int socklisten(int sockfd, int backlog)
 // called from sys_accept() in kernel/sysfile.c
 // https://man7.org/linux/man-pages/man2/accept.2.html
 // returns a new socket on success, or -1 on error
-int sockaccept(int sockfd, struct sockaddr *addr, int *addrlen, char nonblocking)
+int sockaccept(struct socket *sock, struct sockaddr *addr, int *addrlen, char nonblocking)
 {
-    struct socket *sock = myproc()->ofile[sockfd]->sock;
     if (sock == NULL) {
         printf("sockaccept: invalid socket\n");
         return -1;
     }
+    if (sock->type != SOCK_STREAM)
+        return -1;
+    if (sock->domain == AF_UNIX)
+        return unixaccept(sock, addr, addrlen, nonblocking);
     LWIP_ASSERT("sockaccept: invalid socket state", sock->state == SS_LISTENING || sock->state == SS_ACCEPTING);
 
     // If state is SS_LISTENING, we need to wait for a connection
@@ -721,6 +1009,100 @@ int sockaccept(int sockfd, struct sockaddr *addr, int *addrlen, char nonblocking
 }
 
 
+/* APIS FOR UDP */
+
+
+// called from sys_recvfrom() and sockread()
+// https://man7.org/linux/man-pages/man2/recvfrom.2.html
+// copies the oldest datagram to addr, dropping what does not fit in n,
+// and its source to *from if from is not NULL
+// returns the number of bytes copied on success, or -1 on error
+int sockrecvfrom(struct socket *sock, uint64 addr, int n, struct sockaddr *from, char nonblocking)
+{
+    if (sock->type != SOCK_DGRAM || n < 0)
+        return -1;
+
+    acquire(&sock->lock);
+    while (sock->dgram_head == sock->dgram_tail) {
+        if (nonblocking) {
+            release(&sock->lock);
+            myproc()->error_no = EAGAIN;
+            return -1;
+        }
+        if (myproc()->killed) {
+            release(&sock->lock);
+            return -1;
+        }
+        // will be woken up by sock_udp_recv()
+        sleep(&sock->recv_sem, &sock->lock);
+    }
+
+    // copy under the lock, so the slot is not reused meanwhile
+    struct dgram *d = &sock->dgram[sock->dgram_head % NDGRAM];
+    int len = d->len < n ? d->len : n;
+    for (int k = 0, m; k * PGSIZE < len; k++) {
+        m = LWIP_MIN(len - k * PGSIZE, PGSIZE);
+        if (copyout(myproc()->pagetable, addr + k * PGSIZE, d->data[k], m) < 0) {
+            release(&sock->lock);
+            return -1;
+        }
+    }
+    if (from != NULL) {
+        memset(from, 0, sizeof(*from));
+        from->sa_family = AF_INET;
+        from->sin_port = d->port;
+        from->sin_addr = d->addr;
+    }
+    sock->dgram_head++;
+    release(&sock->lock);
+
+    myproc()->lastread = r_mtime();
+    return len;
+}
+
+// called from sys_sendto() and sockwrite()
+// https://man7.org/linux/man-pages/man2/sendto.2.html
+// sends n bytes at addr as one datagram to *to, or to the peer
+// given to connect() if to is NULL
+// returns n on success, or -1 on error
+int socksendto(struct socket *sock, uint64 addr, int n, const struct sockaddr *to)
+{
+    if (sock->type != SOCK_DGRAM || n < 0 || n > MAXDGRAM)
+        return -1;
+    if (to == NULL && sock->state != SS_CONNECTED)
+        return -1;
+    if (netwait(to ? to->sin_addr : ip_addr_get_ip4_u32(&sock->upcb->remote_ip)) < 0)
+        return -1;
+
+    // PBUF_RAM payloads are contiguous, so copy straight in
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, n, PBUF_RAM);
+    if (p == NULL) {
+        myproc()->error_no = EAGAIN;
+        return -1;
+    }
+    if (copyin(myproc()->pagetable, p->payload, addr, n) < 0) {
+        pbuf_free(p);
+        return -1;
+    }
+
+    err_t err;
+    if (to != NULL) {
+        ip_addr_t ipaddr = {to->sin_addr};
+        err = udp_sendto(sock->upcb, p, &ipaddr, ntohs(to->sin_port));
+    } else {
+        err = udp_send(sock->upcb, p);
+    }
+    pbuf_free(p);
+    if (err != ERR_OK) {
+        printf("socksendto: udp_send failed: %d\n", err);
+        return -1;
+    }
+
+    sock->bytes_out += n;
+    return n;
+}
+
+
 /* APIS FOR DNS */
 
 
@@ -730,41 +1112,22 @@ int sockaccept(int sockfd, struct sockaddr *addr, int *addrlen, char nonblocking
 // returns 0 on success, or -1 on error
 int sockgethostbyname(const char *name, struct sockaddr *addr)
 {
-    // set DNS server address to Google's public DNS server
-    ip_addr_t dns_server = {
-        .addr = DNS_SERVER_IP,
-    };
-    dns_setserver(0, &dns_server);
-
-    // resolve hostname
-    ip_addr_t ipaddr = {0};
-    err_t err = dns_gethostbyname(name, &ipaddr, sock_dns_found, &ipaddr);
-
-    if (err == ERR_OK) {
-        // address already cached, addr->sin_addr set to the cached address
-        printf("sockgethostbyname: found cached address for %s: %s\n", name, ipaddr_ntoa(&ipaddr));
-        addr->sin_addr = ipaddr.addr;
-        return 0;
-    }
-    if (err != ERR_INPROGRESS) {
-        printf("sockgethostbyname: failed to resolve hostname %s\n", name);
+    // see resolv.c; each lookup waits on its own request
+    struct dnsreq *r = dnsstart((char *)name);
+    if (r == NULL) {
+        printf("sockgethostbyname: too many lookups\n");
         return -1;
     }
 
-    printf("sockgethostbyname: waiting for hostname %s to be resolved\n", name);
-
-    // enqueue a request to be sent to the DNS server for resolution
-    // wait for the DNS server to respond
-    // will be woken up by sock_dns_found() when the hostname is resolved
-    sem_wait(&dns_sem.lock, &dns_sem.sem);
-
-    if (ipaddr.addr == 0) {
+    uint32 a;
+    int rc = dnswait(r, 0, &a);
+    dnsclose(r);
+    if (rc != 0) {
         printf("sockgethostbyname: failed to resolve hostname %s\n", name);
         return -1;
     }
 
-    addr->sin_addr = ipaddr.addr;
-    
+    addr->sin_addr = a;
     return 0;
 }
 
@@ -784,6 +1147,18 @@ void sock_poll_wakeup(void)
 {
     acquire(&net_poll_chan.lock);
     if (net_poll_chan.waiting > 0) {
+        wakeuplocal(&net_poll_chan);
+    }
+    release(&net_poll_chan.lock);
+}
+
+// Wake up processes in net_poll with a timeout, so they can
+// see it expire even when the network is quiet
+// Called from clockintr() on every tick
+void sock_poll_tick(void)
+{
+    acquire(&net_poll_chan.lock);
+    if (net_poll_chan.timed > 0) {
         wakeup(&net_poll_chan);
     }
     release(&net_poll_chan.lock);
@@ -799,9 +1174,10 @@ static int sock_has_data(struct socket *sock)
     if (sock->eof_reached)
         return 1;
     
-    // Check if data available in receive buffer
+    // Check if data available in receive buffer, or held back
+    // for sockread() to move there
     int num_avail = sock->recv_avail - sock->recv_used + 1;
-    return num_avail > 0;
+    return num_avail > 0 || sock->recv_pend != NULL;
 }
 
 // Check if a listening socket has a pending connection
@@ -823,6 +1199,70 @@ static int sock_is_closed(struct socket *sock)
     return sock->eof_reached || sock->state == SS_FREE;
 }
 
+// The events of interest that f has ready, for sockpoll();
+// slept is set once sockpoll() has waited for them.
+static short pollfile(struct file *f, short events, int slept)
+{
+    short revents = 0;
+
+    // a resolve() descriptor is readable once the lookup is done
+    if (f->type == FD_DNS)
+        return (events & POLLIN) && dnsready(f->dns) ? POLLIN : 0;
+
+    // Only handle socket file descriptors
+    if (f->type != FD_SOCK)
+        return POLLNVAL;
+
+    struct socket *sock = f->sock;
+
+    if (sock->domain == AF_UNIX)
+        return unixpoll(sock, events);
+
+    // a UDP socket is readable while datagrams are queued,
+    // and can always send
+    if (sock->type == SOCK_DGRAM) {
+        if ((events & POLLIN) && sock->dgram_head != sock->dgram_tail)
+            revents |= POLLIN;
+        if (events & POLLOUT)
+            revents |= POLLOUT;
+        return revents;
+    }
+
+    // Check for requested events
+    if (events & POLLIN) {
+        // For listening sockets, check for pending connections
+        if (sock->state == SS_LISTENING || sock->state == SS_ACCEPTING) {
+            if (sock_has_pending_connection(sock)) {
+                revents |= POLLIN;
+            }
+        }
+        // For connected sockets, check for data
+        else if (sock->state == SS_CONNECTED || sock->state == SS_RECVING) {
+            if (sock_has_data(sock)) {
+                revents |= POLLIN;
+                if (slept && sock->t_signal) {
+                    latrecord(sock, LAT_WAKEUP, sock->t_signal);
+                    sock->t_signal = 0;
+                }
+            }
+        }
+    }
+
+    // Check for write availability (socket is connected and can send)
+    if (events & POLLOUT) {
+        if (sock->state == SS_CONNECTED && tcp_sndbuf(sock->pcb) > 0) {
+            revents |= POLLOUT;
+        }
+    }
+
+    // Check for hangup/error conditions
+    if (sock_is_closed(sock)) {
+        revents |= POLLHUP;
+    }
+
+    return revents;
+}
+
 // Poll multiple file descriptors for network activity
 // Returns the number of file descriptors with events, or -1 on error
 // timeout: -1 = block indefinitely, 0 = return immediately, >0 = timeout in ticks
@@ -830,6 +1270,7 @@ int sockpoll(struct pollfd *fds, int nfds, int timeout)
 {
     struct proc *p = myproc();
     int ready_count = 0;
+    int slept = 0;
     uint start_ticks;
     
     if (nfds <= 0 || nfds > MAX_POLL_FDS)
@@ -853,51 +1294,14 @@ int sockpoll(struct pollfd *fds, int nfds, int timeout)
                 continue;
             }
             
-            if (fd >= NOFILE || p->ofile[fd] == 0) {
-                fds[i].revents = POLLNVAL;
-                ready_count++;
-                continue;
-            }
-            
-            struct file *f = p->ofile[fd];
-            
-            // Only handle socket file descriptors
-            if (f->type != FD_SOCK) {
+            struct file *f = fdget(p, fd);
+            if (f == 0) {
                 fds[i].revents = POLLNVAL;
                 ready_count++;
                 continue;
             }
-            
-            struct socket *sock = f->sock;
-            
-            // Check for requested events
-            if (fds[i].events & POLLIN) {
-                // For listening sockets, check for pending connections
-                if (sock->state == SS_LISTENING || sock->state == SS_ACCEPTING) {
-                    if (sock_has_pending_connection(sock)) {
-                        fds[i].revents |= POLLIN;
-                    }
-                }
-                // For connected sockets, check for data
-                else if (sock->state == SS_CONNECTED || sock->state == SS_RECVING) {
-                    if (sock_has_data(sock)) {
-                        fds[i].revents |= POLLIN;
-                    }
-                }
-            }
-            
-            // Check for write availability (socket is connected and can send)
-            if (fds[i].events & POLLOUT) {
-                if (sock->state == SS_CONNECTED && tcp_sndbuf(sock->pcb) > 0) {
-                    fds[i].revents |= POLLOUT;
-                }
-            }
-            
-            // Check for hangup/error conditions
-            if (sock_is_closed(sock)) {
-                fds[i].revents |= POLLHUP;
-            }
-            
+            fds[i].revents = pollfile(f, fds[i].events, slept);
+            fileclose(f);
             if (fds[i].revents != 0) {
                 ready_count++;
             }
@@ -927,13 +1331,94 @@ int sockpoll(struct pollfd *fds, int nfds, int timeout)
         // Sleep until woken up by network activity
         acquire(&net_poll_chan.lock);
         net_poll_chan.waiting++;
+        if (timeout > 0)
+            net_poll_chan.timed++;
         sleep(&net_poll_chan, &net_poll_chan.lock);
+        if (timeout > 0)
+            net_poll_chan.timed--;
         net_poll_chan.waiting--;
         release(&net_poll_chan.lock);
+        slept = 1;
         
         // Check if process was killed while sleeping
         if (p->killed) {
             return -1;
         }
     }
-}
\ No newline at end of file
+}
+
+/* STATISTICS */
+
+
+// Fill in the socket part of ns; called by netstat() with lwip_lock held.
+void socknetstat(struct netstat *ns)
+{
+    ns->recv_errmem = recv_errmem;
+    ns->nsock = 0;
+    for (int i = 0; i < NSOCK; i++) {
+        struct socket *sock = &sockets[i];
+        if (sock->state == SS_FREE)
+            continue;
+
+        struct netstat_sock *s = &ns->sock[ns->nsock++];
+        s->pid = sock->owner ? sock->owner->pid : 0;
+        s->fd = sock->fd;
+        s->state = sock->state;
+        s->recvq = sock->recv_avail - sock->recv_used + 1;
+        s->bytes_in = sock->bytes_in;
+        s->bytes_out = sock->bytes_out;
+        s->sent_len = sock->sent_len;
+        s->unacked = sock->bytes_out - sock->sent_len;
+
+        if (sock->type == SOCK_DGRAM) {
+            s->tcpstate = -1;
+            s->recvq = 0;
+            for (uint d = sock->dgram_head; d != sock->dgram_tail; d++)
+                s->recvq += sock->dgram[d % NDGRAM].len;
+            s->laddr = ip_addr_get_ip4_u32(&sock->upcb->local_ip);
+            s->raddr = ip_addr_get_ip4_u32(&sock->upcb->remote_ip);
+            s->lport = sock->upcb->local_port;
+            s->rport = sock->upcb->remote_port;
+            continue;
+        }
+
+        struct tcp_pcb *pcb = sock->pcb;
+        if (pcb == NULL) {
+            s->tcpstate = -1;
+            continue;
+        }
+        s->tcpstate = pcb->state;
+        s->laddr = ip_addr_get_ip4_u32(&pcb->local_ip);
+        s->lport = pcb->local_port;
+        // a listening socket's pcb is the smaller tcp_pcb_listen,
+        // which has no remote end; leave raddr and rport zero.
+        if (pcb->state != LISTEN) {
+            s->raddr = ip_addr_get_ip4_u32(&pcb->remote_ip);
+            s->rport = pcb->remote_port;
+            s->sndbuf = tcp_sndbuf(pcb);
+            s->sndqueue = tcp_sndqueuelen(pcb);
+        }
+    }
+}
+
+// called from sys_socklat() in kernel/sysfile.c
+// copies the latency histograms of up to n open sockets to addr
+// returns the number of sockets copied, or -1 on error
+int socklat(uint64 addr, int n)
+{
+    struct socklat sl;
+    int cnt = 0;
+
+    for (int i = 0; i < NSOCK && cnt < n; i++) {
+        struct socket *sock = &sockets[i];
+        if (sock->state == SS_FREE)
+            continue;
+        sl.pid = sock->owner ? sock->owner->pid : 0;
+        sl.fd = sock->fd;
+        sl.h = sock->lat;
+        if (copyout(myproc()->pagetable, addr + cnt * sizeof(sl), (char *)&sl, sizeof(sl)) < 0)
+            return -1;
+        cnt++;
+    }
+    return cnt;
+}
@@ -1,5 +1,6 @@
 // lwip/sockets.h
 /* Socket address family */
+#define AF_UNIX         1
 #define AF_INET         2
 
 /* Socket protocol types (TCP/UDP) */
@@ -19,10 +20,28 @@ typedef enum {
 } socket_state;
 
 #define SEND_BUFLEN 1024
-#define RECV_BUFLEN 1024
+#define RECV_BUFLEN 16384
+
+#ifndef NETMTU
+#define NETMTU 1500                 // as in kernel/lwip/lwipopts.h
+#endif
+
+#define NDGRAM 8                    // datagrams queued per UDP socket
+#define MAXDGRAM (NETMTU - 28)      // largest UDP payload in one IP packet
+#define DGRAMPG ((MAXDGRAM + 4095) / 4096)  // pages per queued datagram
+
+// a received datagram, copied out of its pbuf.
+struct dgram {
+    uint32 addr;                    // source address in network byte order
+    uint16 port;                    // source port in network byte order
+    uint16 len;
+    char *data[DGRAMPG];            // MAXDGRAM bytes, a page at a time
+};
+
+#define UNIX_PATH_MAX 64
 
 struct socket {
-    int domain;                     // address family, always AF_INET
+    int domain;                     // address family, AF_INET or AF_UNIX
     int type;                       // socket type, SOCK_STREAM or SOCK_DGRAM
     int protocol;                   // always 0
     socket_state state;             // socket state
@@ -33,10 +52,13 @@ struct socket {
     int accept_fd;                  // for listening sockets
 
     int sent_len;                   // total number of bytes sent
+    uint64 bytes_out;               // total number of bytes written
+    uint64 bytes_in;                // total number of bytes received
     uint8 send_buf[SEND_BUFLEN];    // send buffer
 
     int recv_avail;                 // pointer to the next available byte in recv_buf
     int recv_used;                  // pointer to the next byte to be read from recv_buf
+    struct pbuf *recv_pend;         // received data that did not fit in recv_buf
     int eof_reached;                // end of file reached
     uint8 recv_buf[RECV_BUFLEN];    // receive buffer
 
@@ -45,8 +67,27 @@ struct socket {
     struct file *file;              // file pointer
     int fd;                         // file descriptor
 
+    // SOCK_DGRAM only; the queue is protected by socket lock
+    struct udp_pcb *upcb;
+    struct dgram dgram[NDGRAM];
+    uint dgram_head;                // next datagram to read
+    uint dgram_tail;                // next free slot
+    uint64 dgram_drops;             // arrived to a full queue
+
+    // AF_UNIX only; see unixsock.c
+    struct pipe *rx;                // bytes from the peer
+    struct pipe *tx;                // bytes to the peer
+    char path[UNIX_PATH_MAX];       // bound name, or ""
+
     int sem;                        // semaphore for async operations, protected by socket lock
     int recv_sem;                   // semaphore for async recv operations, protected by socket lock
+
+    // latency instrumentation, see socklat.h; times from r_mtime()
+    uint64 t_recv;                  // sock_recv() of the oldest unread data, or 0
+    uint64 t_signal;                // sock_recv() wakeup not yet recorded, or 0
+    uint64 t_last;                  // last sock_recv() that queued data
+    uint64 t_output;                // tcp_output() of data not yet acknowledged, or 0
+    struct lathist lat;
 };
 
 struct sockaddr
@@ -57,6 +98,13 @@ struct sockaddr
     uint8 sin_zero[8];      // zero this if you want to
 };
 
+// AF_UNIX address: a name in a kernel table, not a file
+struct sockaddr_un
+{
+    uint16 sun_family;              // AF_UNIX
+    char sun_path[UNIX_PATH_MAX];   // NUL-terminated name
+};
+
 // fixed DNS server address
 #define MAX_DOMAIN_NAME 256
 #define MAX_ADDRESS_LENGTH 256
@@ -0,0 +1,26 @@
+// Per-socket latency histograms returned by socklat().
+// Latencies are in CLINT mtime ticks (10 MHz under qemu) and
+// counted in power-of-two buckets: bucket 0 holds 0, and
+// bucket i holds latencies in [2^(i-1), 2^i).
+#define NLATBUCKET 32
+
+// The stages of a chat message's trip through the kernel.
+enum {
+  LAT_LWIPRX,   // driver RX -> sock_recv(): lwIP input processing
+  LAT_WAKEUP,   // sock_recv() -> reader running again, from read() or net_poll()
+  LAT_RING,     // sock_recv() -> read() copies the data out
+  LAT_APP,      // read() -> the same process's next write()
+  LAT_TX,       // write() -> tcp_output() returns: lwIP and driver send
+  LAT_ACK,      // tcp_output() -> the peer acknowledges the data
+  NLATSTAGE
+};
+
+struct lathist {
+  uint32 n[NLATSTAGE][NLATBUCKET];
+};
+
+struct socklat {
+  int pid;             // Owner
+  int fd;
+  struct lathist h;
+};
@@ -6,6 +6,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
 #define NLOCK 1000
@@ -22,6 +23,8 @@ initlock(struct spinlock *lk, char *name)
   lk->cpu = 0;
   lk->nts = 0;
   lk->n = 0;
+  lk->holdtime = 0;
+  lk->maxhold = 0;
   if(nlock >= NLOCK)
     panic("initlock");
   locks[nlock] = lk;
@@ -55,6 +58,7 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->tacquired = r_mtime();
 }
 
 // Release the lock.
@@ -64,6 +68,11 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  uint64 held = r_mtime() - lk->tacquired;
+  lk->holdtime += held;
+  if(held > lk->maxhold)
+    lk->maxhold = held;
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -176,3 +185,63 @@ sys_ntas(void)
   }
   return tot;
 }
+
+// Sum the statistics of every lock named like locks[i].
+static void
+lockstat1(int i, struct lockstat *ls)
+{
+  struct spinlock *lk;
+
+  memset(ls, 0, sizeof(*ls));
+  safestrcpy(ls->name, locks[i]->name, sizeof(ls->name));
+  for(; i < nlock; i++){
+    lk = locks[i];
+    if(strncmp(lk->name, ls->name, sizeof(ls->name)) != 0)
+      continue;
+    ls->nlocks++;
+    ls->nacquire += lk->n;
+    ls->nspin += lk->nts;
+    ls->holdtime += lk->holdtime;
+    if(lk->maxhold > ls->maxhold)
+      ls->maxhold = lk->maxhold;
+  }
+}
+
+// lockstat(struct lockstat *ls, int n, int reset):
+// copy out statistics for up to n lock names, one entry per
+// name, and then zero the counters of all locks if reset is set.
+// Returns the number of entries written.
+uint64
+sys_lockstat(void)
+{
+  struct lockstat ls;
+  uint64 addr;
+  int n, reset, i, j, cnt;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0)
+    return -1;
+
+  cnt = 0;
+  for(i = 0; i < nlock && cnt < n; i++){
+    // only the first lock with each name starts an entry.
+    for(j = 0; j < i; j++)
+      if(strncmp(locks[j]->name, locks[i]->name, sizeof(ls.name)) == 0)
+        break;
+    if(j < i)
+      continue;
+    lockstat1(i, &ls);
+    if(copyout(myproc()->pagetable, addr + cnt*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+    cnt++;
+  }
+
+  if(reset){
+    for(i = 0; i < nlock; i++){
+      locks[i]->n = 0;
+      locks[i]->nts = 0;
+      locks[i]->holdtime = 0;
+      locks[i]->maxhold = 0;
+    }
+  }
+  return cnt;
+}
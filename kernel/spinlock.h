@@ -5,7 +5,10 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-  uint n;
-  uint nts;
+  uint n;            // Number of acquire() calls
+  uint nts;          // Number of spins waiting for the lock
+  uint64 tacquired;  // r_mtime() when last acquired
+  uint64 holdtime;   // Total time held
+  uint64 maxhold;    // Longest time held
 };
 
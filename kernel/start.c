@@ -43,6 +43,11 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor and user mode read the cycle, time and
+  // instret counters, e.g. for membench's rdcycle.
+  w_mcounteren(r_mcounteren() | COUNTEREN_CY | COUNTEREN_TM | COUNTEREN_IR);
+  w_scounteren(r_scounteren() | COUNTEREN_CY | COUNTEREN_TM | COUNTEREN_IR);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -65,7 +70,7 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
+  int interval = TIMERINTERVAL;
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
@@ -86,3 +91,13 @@ timerinit()
   // enable machine-mode timer interrupts.
   w_mie(r_mie() | MIE_MTIE);
 }
+
+// change the interval between timer interrupts on every CPU,
+// e.g. for the profiler. each CPU's timervec picks up the
+// new value when it next schedules an interrupt.
+void
+timerinterval(uint64 interval)
+{
+  for(int i = 0; i < NCPU; i++)
+    timer_scratch[i][4] = interval;
+}
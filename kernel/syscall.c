@@ -12,7 +12,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
+  if(addr >= p->vm->sz || addr+sizeof(uint64) > p->vm->sz)
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -116,6 +116,24 @@ extern uint64 sys_inetaddress(void);
 extern uint64 sys_timenow(void);
 extern uint64 sys_net_poll(void);
 extern uint64 sys_fcntl(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_profctl(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_netstat(void);
+extern uint64 sys_socklat(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_sendto(void);
+extern uint64 sys_recvfrom(void);
+extern uint64 sys_resolve(void);
+extern uint64 sys_dnsserver(void);
+extern uint64 sys_iperf(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -152,6 +170,24 @@ static uint64 (*syscalls[])(void) = {
 [SYS_net_poll] sys_net_poll,
 [SYS_fcntl]   sys_fcntl,
 [SYS_net_poll] sys_net_poll,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_lockstat] sys_lockstat,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
+[SYS_netstat] sys_netstat,
+[SYS_socklat] sys_socklat,
+[SYS_clone]   sys_clone,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_splice]  sys_splice,
+[SYS_sendto]  sys_sendto,
+[SYS_recvfrom] sys_recvfrom,
+[SYS_resolve] sys_resolve,
+[SYS_dnsserver] sys_dnsserver,
+[SYS_iperf]   sys_iperf,
 };
 
 void
@@ -33,4 +33,22 @@
 #define SYS_inetaddress     30
 #define SYS_timenow     31
 #define SYS_net_poll        32
-#define SYS_fcntl           33
\ No newline at end of file
+#define SYS_fcntl           33
+#define SYS_setaffinity     34
+#define SYS_lockstat        35
+#define SYS_profctl         36
+#define SYS_profread        37
+#define SYS_netstat         38
+#define SYS_socklat         39
+#define SYS_clone           40
+#define SYS_futex_wait      41
+#define SYS_futex_wake      42
+#define SYS_shmget          43
+#define SYS_shmat           44
+#define SYS_shmdt           45
+#define SYS_splice          46
+#define SYS_sendto          47
+#define SYS_recvfrom        48
+#define SYS_resolve         49
+#define SYS_dnsserver       50
+#define SYS_iperf           51
\ No newline at end of file
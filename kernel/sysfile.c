@@ -15,10 +15,14 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "socklat.h"
 #include "socket.h"
+#include "iperf.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// The file comes with a reference of its own, since a thread sharing
+// the table may close fd meanwhile; fileclose() it when done.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -27,43 +31,90 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(myproc(), fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
+  else
+    fileclose(f);
   return 0;
 }
 
+// Like argfd, for a socket.
+static int
+argsock(int n, struct file **pf)
+{
+  if(argfd(n, 0, pf) < 0)
+    return -1;
+  if((*pf)->type != FD_SOCK){
+    fileclose(*pf);
+    return -1;
+  }
+  return 0;
+}
+
+// Return the file open as fd in p, with a new reference, or 0.
+struct file*
+fdget(struct proc *p, int fd)
+{
+  struct fdtable *fdt = p->fdt;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE || fdt == 0)
+    return 0;
+  acquire(&fdt->lock);
+  if((f = fdt->ofile[fd]) != 0)
+    filedup(f);
+  release(&fdt->lock);
+  return f;
+}
+
+// Remove fd from p's table. Returns the file it held, whose
+// reference passes to the caller, or 0.
+static struct file*
+fdtake(struct proc *p, int fd)
+{
+  struct fdtable *fdt = p->fdt;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE || fdt == 0)
+    return 0;
+  acquire(&fdt->lock);
+  f = fdt->ofile[fd];
+  fdt->ofile[fd] = 0;
+  release(&fdt->lock);
+  return f;
+}
+
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
 int
 fdalloc(struct file *f)
 {
-  int fd;
-  struct proc *p = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
+  return fdalloc_for_proc(f, myproc());
 }
 
 int
 fdalloc_for_proc(struct file *f, struct proc *p)
 {
   int fd;
+  struct fdtable *fdt = p->fdt;
+
+  if(fdt == 0)
+    return -1;  // p has exited
 
+  // threads of p may share the table.
+  acquire(&fdt->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(fdt->ofile[fd] == 0){
+      fdt->ofile[fd] = f;
+      release(&fdt->lock);
       return fd;
     }
   }
+  release(&fdt->lock);
   return -1;
 }
 
@@ -73,11 +124,11 @@ sys_dup(void)
   struct file *f;
   int fd;
 
+  // fdalloc takes over argfd's reference.
   if(argfd(0, 0, &f) < 0)
     return -1;
   if((fd=fdalloc(f)) < 0)
-    return -1;
-  filedup(f);
+    fileclose(f);
   return fd;
 }
 
@@ -85,25 +136,28 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -112,9 +166,8 @@ sys_close(void)
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || (f = fdtake(myproc(), fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -124,10 +177,13 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -337,9 +393,7 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
     return -1;
@@ -357,6 +411,16 @@ sys_open(void)
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
+  // only a complete file goes in the table, where other
+  // threads sharing it can use fd at once.
+  if((fd = fdalloc(f)) < 0){
+    f->type = FD_NONE;
+    fileclose(f);
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
   }
@@ -485,15 +549,15 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdtake(p, fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdtake(p, fd0);
+    fdtake(p, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -507,73 +571,108 @@ sys_socket(void)
   int domain, type, protocol;
   if(argint(0, &domain) < 0 || argint(1, &type) < 0 || argint(2, &protocol) < 0)
     return -1;
-  return sockalloc(domain, type, protocol, 0, 0);
+  return sockalloc(domain, type, protocol, 0, 0, 0);
+}
+
+// Fetch the name in the sockaddr_un at user address uaddr,
+// for bind() and connect() on AF_UNIX.
+static int
+argunix(uint64 uaddr, char *path)
+{
+  struct sockaddr_un sun;
+
+  if(copyin(myproc()->pagetable, (char*)&sun, uaddr, sizeof(sun)) < 0)
+    return -1;
+  safestrcpy(path, sun.sun_path, UNIX_PATH_MAX);
+  return 0;
 }
 
 uint64
 sys_connect(void)
 {
-  int sockfd;
+  struct file *f;
   uint64 user_addr;
   struct sockaddr addr;
-  int addrlen;
+  char path[UNIX_PATH_MAX];
+  int addrlen, r;
   
-  if (argint(0, &sockfd) < 0 || argaddr(1, &user_addr) < 0 || argint(2, &addrlen) < 0)
+  if (argaddr(1, &user_addr) < 0 || argint(2, &addrlen) < 0)
     return -1;
 
   // copy struct sockaddr from user space to kernel space
   if (copyin(myproc()->pagetable, (char*)&addr, user_addr, sizeof(addr)) < 0)
     return -1;
+  if (addr.sa_family == AF_UNIX && argunix(user_addr, path) < 0)
+    return -1;
 
-  return sockconnect(sockfd, &addr, addrlen);
+  if (argsock(0, &f) < 0)
+    return -1;
+  if (addr.sa_family == AF_UNIX)
+    r = unixconnect(f->sock, path);
+  else
+    r = sockconnect(f->sock, &addr, addrlen);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_bind(void)
 {
-  int sockfd;
+  struct file *f;
   uint64 user_addr;
   struct sockaddr addr;
-  int addrlen;
-  if (argint(0, &sockfd) < 0 || argaddr(1, &user_addr) < 0 || argint(2, &addrlen) < 0)
+  char path[UNIX_PATH_MAX];
+  int addrlen, r;
+
+  if (argaddr(1, &user_addr) < 0 || argint(2, &addrlen) < 0)
     return -1;
 
   // copy struct sockaddr from user space to kernel space
   if (copyin(myproc()->pagetable, (char*)&addr, user_addr, sizeof(addr)) < 0)
     return -1;
-  
-  return sockbind(sockfd,  &addr, addrlen);
+  if (addr.sa_family == AF_UNIX && argunix(user_addr, path) < 0)
+    return -1;
+
+  if (argsock(0, &f) < 0)
+    return -1;
+  if (addr.sa_family == AF_UNIX)
+    r = unixbind(f->sock, path);
+  else
+    r = sockbind(f->sock, &addr, addrlen);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_listen(void)
 {
-  int sockfd, backlog;
-  if(argint(0, &sockfd) < 0 || argint(1, &backlog) < 0)
+  struct file *f;
+  int backlog, r;
+
+  if(argint(1, &backlog) < 0 || argsock(0, &f) < 0)
     return -1;
-  return socklisten(sockfd, backlog);
+  r = socklisten(f->sock, backlog);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_accept(void)
 {
-  int sockfd;
+  struct file *f;
   uint64 user_addr;
   uint64 user_addrlen;
   
-  if(argint(0, &sockfd) < 0 || argaddr(1, &user_addr) < 0 || argaddr(2, &user_addrlen) < 0)
+  if(argaddr(1, &user_addr) < 0 || argaddr(2, &user_addrlen) < 0 || argsock(0, &f) < 0)
     return -1;
   
   struct sockaddr addr;
   int addrlen;
   int new_sockfd;
-  
-  struct proc *p = myproc();
-  struct file *f = p->ofile[sockfd];
-  if (!f || f->type != FD_SOCK)
-    return -1;
 
-  if ((new_sockfd = sockaccept(sockfd, &addr, &addrlen, f->nonblocking)) < 0)
+  new_sockfd = sockaccept(f->sock, &addr, &addrlen, f->nonblocking);
+  fileclose(f);
+  if (new_sockfd < 0)
     return -1;
   
   pagetable_t pagetable = myproc()->pagetable;
@@ -584,6 +683,50 @@ sys_accept(void)
   return new_sockfd;
 }
 
+uint64
+sys_sendto(void)
+{
+  struct file *f;
+  uint64 buf, user_addr;
+  struct sockaddr to;
+  int n, r, addrlen;
+
+  if(argaddr(1, &buf) < 0 || argint(2, &n) < 0 ||
+     argaddr(3, &user_addr) < 0 || argint(4, &addrlen) < 0)
+    return -1;
+  if(user_addr != 0 && copyin(myproc()->pagetable, (char*)&to, user_addr, sizeof(to)) < 0)
+    return -1;
+  if(argsock(0, &f) < 0)
+    return -1;
+  r = socksendto(f->sock, buf, n, user_addr ? &to : 0);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_recvfrom(void)
+{
+  struct file *f;
+  uint64 buf, user_addr, user_addrlen;
+  struct sockaddr from;
+  int n, r, addrlen = sizeof(from);
+  pagetable_t pagetable = myproc()->pagetable;
+
+  if(argaddr(1, &buf) < 0 || argint(2, &n) < 0 ||
+     argaddr(3, &user_addr) < 0 || argaddr(4, &user_addrlen) < 0 ||
+     argsock(0, &f) < 0)
+    return -1;
+  r = sockrecvfrom(f->sock, buf, n, &from, f->nonblocking);
+  fileclose(f);
+  if(r < 0)
+    return -1;
+  if(user_addr != 0 && copyout(pagetable, user_addr, (char*)&from, sizeof(from)) < 0)
+    return -1;
+  if(user_addrlen != 0 && copyout(pagetable, user_addrlen, (char*)&addrlen, sizeof(addrlen)) < 0)
+    return -1;
+  return r;
+}
+
 uint64
 sys_gethostbyname(void)
 {
@@ -609,6 +752,64 @@ sys_gethostbyname(void)
   return rc;
 }
 
+// Start looking up a host name; returns a descriptor that
+// reads as its address once the lookup is done.
+uint64
+sys_resolve(void)
+{
+  char name[MAX_DOMAIN_NAME];
+  struct dnsreq *r;
+  struct file *f;
+  int fd;
+
+  if(argstr(0, name, MAX_DOMAIN_NAME) < 0)
+    return -1;
+  if((r = dnsstart(name)) == 0)
+    return -1;
+  if((f = filealloc()) == 0){
+    dnsclose(r);
+    return -1;
+  }
+  f->type = FD_DNS;
+  f->dns = r;
+  f->readable = 1;
+  f->writable = 0;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);  // closes r
+    return -1;
+  }
+  return fd;
+}
+
+uint64
+sys_dnsserver(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  resolvserver(addr);
+  return 0;
+}
+
+// Run an iperf test inside the kernel; see iperf.c.
+uint64
+sys_iperf(void)
+{
+  int mode, addr, port;
+  uint64 uaddr;
+  struct iperfreport r;
+
+  if(argint(0, &mode) < 0 || argint(1, &addr) < 0 || argint(2, &port) < 0 ||
+     argaddr(3, &uaddr) < 0)
+    return -1;
+  if(iperf(mode, addr, port, &r) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, uaddr, (char*)&r, sizeof(r)) < 0)
+    return -1;
+  return 0;
+}
+
 /*
 input: (char *) ip address
 output: networking style address
@@ -680,17 +881,11 @@ sys_net_poll(void)
   return rc;
 }
 
-uint64
-sys_fcntl(void)
+static int
+fcntl(struct file *f, int cmd)
 {
-  struct file *f;
-  int fd, cmd, arg;
-  
-  if (argfd(0, &fd, &f) < 0)
-    return -1;
-  if (argint(1, &cmd) < 0)
-    return -1;
-  
+  int arg;
+
   switch (cmd) {
     case F_GETFL:
       // Return current file status flags
@@ -707,7 +902,76 @@ sys_fcntl(void)
       f->nonblocking = (arg & O_NONBLOCK) ? 1 : 0;
       return 0;
     
+    case F_GETPIPE_SZ:
+      if (f->type != FD_PIPE)
+        return -1;
+      return pipegetsize(f->pipe);
+
+    case F_SETPIPE_SZ:
+      if (f->type != FD_PIPE || argint(2, &arg) < 0)
+        return -1;
+      return pipesetsize(f->pipe, arg);
+
     default:
       return -1;
   }
-}
\ No newline at end of file
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, r;
+  
+  if (argint(1, &cmd) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = fcntl(f, cmd);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_netstat(void)
+{
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  return netstat(addr);
+}
+
+uint64
+sys_socklat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return socklat(addr, n);
+}
+
+// Move up to len bytes from fd_in to fd_out inside the kernel.
+// Only a pipe to a connected socket is supported.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int len, r;
+
+  if(argint(2, &len) < 0 || argfd(0, 0, &in) < 0)
+    return -1;
+  if(argfd(1, 0, &out) < 0){
+    fileclose(in);
+    return -1;
+  }
+  if(in->type != FD_PIPE || !in->readable || out->type != FD_SOCK || !out->writable)
+    r = -1;
+  else if(len <= 0)
+    r = 0;
+  else
+    r = socksplice(out->sock, in->pipe, len);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
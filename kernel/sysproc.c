@@ -41,15 +41,21 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  return growproc(n);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
     return -1;
-  return addr;
+  return clone(fn, arg, stack);
 }
 
 uint64
@@ -95,3 +101,92 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// set the CPU affinity mask of a process; see setaffinity().
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+// start (or with 0, stop) the sampling profiler; see profctl().
+uint64
+sys_profctl(void)
+{
+  int mult;
+
+  if(argint(0, &mult) < 0)
+    return -1;
+  return profctl(mult);
+}
+
+// sleep on a user word while it holds a value; see futexwait().
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val, timeout;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  return futexwait(addr, val, timeout);
+}
+
+// wake up to n sleepers on a user word; see futexwake().
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+// find or create a shared-memory segment; see shmget().
+uint64
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmget(key, size);
+}
+
+uint64
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
+// drain up to n profiler samples into a user buffer.
+uint64
+sys_profread(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return profread(addr, n);
+}
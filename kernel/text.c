@@ -0,0 +1,278 @@
+// Program images shared by exec().
+//
+// exec() does not copy a program into the new process. It
+// finds the program's text, which holds each page of the image
+// that has bytes from the file, read once through the buffer
+// cache, and the process maps those pages on first touch (see
+// uvmfault()): read-only and shared with every other process
+// running the same program until it writes one, when it gets a
+// private copy. Pages past the file bytes of a segment are
+// zero-filled on first touch, and are not kept here.
+//
+// A text is keyed by the program's device and inode number and
+// counts the address spaces using it. An unused text stays
+// cached until its slot or its memory is needed, so starting a
+// program that ran recently reads nothing from the file.
+// Writing to or truncating the file drops it; address spaces
+// still using the old image keep it until they go away.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "elf.h"
+
+// An image's pages are found through a page of index pages, each
+// holding PTRPG page pointers, so an image may span TEXTMAXPG pages
+// (1 GB); index pages are allocated for the ranges that are used.
+#define PTRPG (PGSIZE / sizeof(char*))
+#define TEXTMAXPG (PTRPG * PTRPG)
+
+struct text {
+  int used;                    // slot in use
+  int cached;                  // dev and inum name the current file
+  uint dev;
+  uint inum;
+  int ref;                     // address spaces using it
+  uint stamp;                  // when last exec()ed, for eviction
+  uint64 sz;                   // end of the image
+  int npages;                  // pages up to the last file-backed one
+  char ***dir;                 // page i of the image is
+                               // dir[i/PTRPG][i%PTRPG], or 0 if zero
+};
+
+static struct spinlock textlock;
+static struct text text[NTEXT];
+static uint textstamp;
+
+void
+textinit(void)
+{
+  initlock(&textlock, "text");
+}
+
+// free t's pages. caller holds textlock, or owns t.
+static void
+textfree(struct text *t)
+{
+  char **leaf;
+
+  if(t->dir){
+    for(int i = 0; i < PTRPG; i++){
+      if((leaf = t->dir[i]) == 0)
+        continue;
+      for(int j = 0; j < PTRPG; j++)
+        if(leaf[j])
+          kfree(leaf[j]);
+      kfree((char*)leaf);
+    }
+    kfree((char*)t->dir);
+  }
+  t->dir = 0;
+  t->npages = 0;
+  t->sz = 0;
+  t->cached = 0;
+  t->used = 0;
+}
+
+// The slot for page pg of t's image, allocating its index page
+// if need be. Returns 0 if pg is out of range or memory is short.
+static char**
+textslot(struct text *t, uint64 pg)
+{
+  char **leaf;
+
+  if(pg >= TEXTMAXPG)
+    return 0;
+  if((leaf = t->dir[pg / PTRPG]) == 0){
+    if((leaf = (char**)kalloc()) == 0)
+      return 0;
+    memset(leaf, 0, PGSIZE);
+    t->dir[pg / PTRPG] = leaf;
+  }
+  return &leaf[pg % PTRPG];
+}
+
+// Read the loadable segments of ip, described by elf, into t.
+// Caller holds ip->lock. Returns 0 or -1.
+static int
+textload(struct text *t, struct inode *ip, struct elfhdr *elf)
+{
+  struct proghdr ph;
+  uint64 va, n, pg;
+  int i, off;
+  char *mem, **slot;
+
+  if((t->dir = (char***)kalloc()) == 0)
+    return -1;
+  memset(t->dir, 0, PGSIZE);
+
+  for(i=0, off=elf->phoff; i<elf->phnum; i++, off+=sizeof(ph)){
+    if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
+      return -1;
+    if(ph.type != ELF_PROG_LOAD)
+      continue;
+    if(ph.memsz < ph.filesz)
+      return -1;
+    if(ph.vaddr + ph.memsz < ph.vaddr)
+      return -1;
+    if((ph.vaddr % PGSIZE) != 0)
+      return -1;
+    // the stack goes above the image, so leave room for it.
+    if(ph.vaddr + ph.memsz > SHMBASE - 2*PGSIZE)
+      return -1;
+    if(ph.vaddr + ph.memsz > t->sz)
+      t->sz = ph.vaddr + ph.memsz;
+    for(va = 0; va < ph.filesz; va += PGSIZE){
+      pg = (ph.vaddr + va) / PGSIZE;
+      if((slot = textslot(t, pg)) == 0 || *slot || (mem = kalloc()) == 0)
+        return -1;
+      memset(mem, 0, PGSIZE);
+      *slot = mem;
+      if(pg >= t->npages)
+        t->npages = pg + 1;
+      n = ph.filesz - va < PGSIZE ? ph.filesz - va : PGSIZE;
+      if(readi(ip, 0, (uint64)mem, ph.off + va, n) != (int)n)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+// Return the text of the program in ip, whose ELF header is
+// elf, reading it if it is not cached, with a reference for
+// the caller. Caller holds ip->lock. Returns 0 on failure.
+struct text*
+textget(struct inode *ip, struct elfhdr *elf)
+{
+  struct text *t, *victim = 0;
+
+  acquire(&textlock);
+  for(t = text; t < &text[NTEXT]; t++){
+    if(t->cached && t->dev == ip->dev && t->inum == ip->inum){
+      t->ref++;
+      t->stamp = ++textstamp;
+      release(&textlock);
+      return t;
+    }
+    // prefer a free slot, then the least recently used idle one.
+    if(!t->used && (victim == 0 || victim->used))
+      victim = t;
+    else if(t->used && t->ref == 0 &&
+            (victim == 0 || (victim->used && t->stamp < victim->stamp)))
+      victim = t;
+  }
+  if((t = victim) == 0){
+    release(&textlock);
+    return 0;
+  }
+  if(t->used)
+    textfree(t);
+  // not cached until loaded, so no one else finds it meanwhile.
+  // another exec() of ip waits for ip->lock.
+  t->used = 1;
+  t->ref = 1;
+  t->stamp = ++textstamp;
+  release(&textlock);
+
+  if(textload(t, ip, elf) < 0){
+    acquire(&textlock);
+    textfree(t);
+    release(&textlock);
+    return 0;
+  }
+
+  acquire(&textlock);
+  t->dev = ip->dev;
+  t->inum = ip->inum;
+  t->cached = 1;
+  release(&textlock);
+  return t;
+}
+
+// Add a reference to t, for fork().
+struct text*
+textdup(struct text *t)
+{
+  if(t){
+    acquire(&textlock);
+    t->ref++;
+    release(&textlock);
+  }
+  return t;
+}
+
+// Drop a reference to t. A text the file no longer matches is
+// freed with its last reference; others stay cached.
+void
+textput(struct text *t)
+{
+  if(t == 0)
+    return;
+  acquire(&textlock);
+  if(--t->ref == 0 && !t->cached)
+    textfree(t);
+  release(&textlock);
+}
+
+// The file in ip is changing, so forget its text.
+void
+textinval(struct inode *ip)
+{
+  struct text *t;
+
+  acquire(&textlock);
+  for(t = text; t < &text[NTEXT]; t++){
+    if(t->cached && t->dev == ip->dev && t->inum == ip->inum){
+      t->cached = 0;
+      if(t->ref == 0)
+        textfree(t);
+    }
+  }
+  release(&textlock);
+}
+
+// Free the cached texts no one is using, for kalloc() when
+// memory runs out. Returns 1 if it freed any, 0 if not.
+int
+textreclaim(void)
+{
+  struct text *t;
+  int freed = 0;
+
+  acquire(&textlock);
+  for(t = text; t < &text[NTEXT]; t++){
+    if(t->used && t->cached && t->ref == 0){
+      textfree(t);
+      freed = 1;
+    }
+  }
+  release(&textlock);
+  return freed;
+}
+
+// End of t's image: exec() puts the stack above it.
+uint64
+textsize(struct text *t)
+{
+  return t->sz;
+}
+
+// The page of t's image at va, or 0 if it is all zeros.
+// The page is shared, so callers must not write to it.
+char*
+textpage(struct text *t, uint64 va)
+{
+  uint64 i = va / PGSIZE;
+  char **leaf;
+
+  if(i >= t->npages || (leaf = t->dir[i / PTRPG]) == 0)
+    return 0;
+  return leaf[i % PTRPG];
+}
@@ -69,7 +69,12 @@ usertrap(void)
 
     syscall();
   } else if((which_dev = devintr()) != 0){
-    // ok
+    if(which_dev >= 2)
+      profsample(0, 0, 0);
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmfault(r_stval(), r_scause() == 12 ? PTE_X :
+                                r_scause() == 13 ? PTE_R : PTE_W) == 0){
+    // a page of the program image, mapped on first touch.
   } else {
     printf("usertrap(): unexpected scause %p (%s) pid=%d\n", r_scause(), scause_desc(r_scause()), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -127,7 +132,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->tfva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -151,6 +156,11 @@ kerneltrap()
     panic("kerneltrap");
   }
 
+  // kernelvec saved the interrupted s0 at 56(sp), and
+  // our frame pointer is the sp kernelvec called us with.
+  if(which_dev >= 2)
+    profsample(1, sepc, ((uint64*)r_fp())[7]);
+
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
     yield();
@@ -168,11 +178,14 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  sock_poll_tick();
+  futextick();
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
+// 3 if a timer interrupt that is only for the profiler,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -207,14 +220,17 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    if(!proftick())
+      return 3;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
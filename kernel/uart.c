@@ -27,9 +27,25 @@
 #define LCR 3 // line control register
 #define LSR 5 // line status register
 
+#define IER_RX_ENABLE (1<<0)
+#define IER_TX_ENABLE (1<<1)
+#define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
+#define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
+
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
+// the transmit output buffer, drained into THR by uartstart()
+// from the transmit-empty interrupt. uart_tx_w and uart_tx_r
+// only grow; the ring is full when w == r + UART_TX_BUF_SIZE.
+struct spinlock uart_tx_lock;
+#define UART_TX_BUF_SIZE 1024
+char uart_tx_buf[UART_TX_BUF_SIZE];
+uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
+uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+
+static void uartstart(void);
+
 void
 uartinit(void)
 {
@@ -52,18 +68,91 @@ uartinit(void)
   // reset and enable FIFOs.
   WriteReg(FCR, 0x07);
 
-  // enable receive interrupts.
-  WriteReg(IER, 0x01);
+  // enable transmit and receive interrupts.
+  WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+
+  initlock(&uart_tx_lock, "uart");
 }
 
-// write one output character to the UART.
+// append n characters to the output buffer, sleeping while it
+// is full. the whole call holds uart_tx_lock except while asleep,
+// so writes that fit in the buffer are not interleaved.
+// only for process context: write() to the console.
+void
+uartwrite(char *buf, int n)
+{
+  int i;
+
+  acquire(&uart_tx_lock);
+  for(i = 0; i < n; i++){
+    while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      // buffer is full; uartintr() wakes us when THR drains it.
+      uartstart();
+      sleep(&uart_tx_r, &uart_tx_lock);
+    }
+    uart_tx_buf[uart_tx_w++ % UART_TX_BUF_SIZE] = buf[i];
+  }
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// add one character to the output buffer without sleeping,
+// for kernel printf() and input echo, which may run in
+// interrupt context or with other locks held. if the buffer
+// is full, wait for the UART to take a character, the way
+// uartputc used to for every character.
 void
 uartputc(int c)
 {
+  acquire(&uart_tx_lock);
+  while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    uartstart();
+  }
+  uart_tx_buf[uart_tx_w++ % UART_TX_BUF_SIZE] = c;
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// polled output that bypasses uart_tx_lock, for panic(): the
+// lock may be held by a CPU that will never release it.
+// flushes whatever is still buffered first, to keep order.
+void
+uartputc_sync(int c)
+{
+  push_off();
+
+  while(uart_tx_w != uart_tx_r){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    WriteReg(THR, uart_tx_buf[uart_tx_r++ % UART_TX_BUF_SIZE]);
+  }
+
   // wait for Transmit Holding Empty to be set in LSR.
-  while((ReadReg(LSR) & (1 << 5)) == 0)
+  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
     ;
   WriteReg(THR, c);
+
+  pop_off();
+}
+
+// move buffered characters into THR for as long as the UART
+// will take them. caller must hold uart_tx_lock. does not wake
+// writers, since kernel printf() may call here holding any
+// lock; uartintr() does that.
+static void
+uartstart(void)
+{
+  while(uart_tx_w != uart_tx_r){
+    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+      // the UART transmit holding register is full,
+      // so we cannot give it another byte.
+      // it will interrupt when it's ready for a new byte.
+      return;
+    }
+    WriteReg(THR, uart_tx_buf[uart_tx_r++ % UART_TX_BUF_SIZE]);
+  }
 }
 
 // read one input character from the UART.
@@ -71,7 +160,7 @@ uartputc(int c)
 int
 uartgetc(void)
 {
-  if(ReadReg(LSR) & 0x01){
+  if(ReadReg(LSR) & LSR_RX_READY){
     // input data is ready.
     return ReadReg(RHR);
   } else {
@@ -79,14 +168,26 @@ uartgetc(void)
   }
 }
 
-// trap.c calls here when the uart interrupts.
+// handle a uart interrupt, raised because input has
+// arrived, or the uart is ready for more output, or
+// both. called from trap.c.
 void
 uartintr(void)
 {
+  // reading ISR acknowledges a pending transmit-empty interrupt.
+  ReadReg(ISR);
+
+  // read and process incoming characters.
   while(1){
     int c = uartgetc();
     if(c == -1)
       break;
     consoleintr(c);
   }
+
+  // send buffered characters.
+  acquire(&uart_tx_lock);
+  uartstart();
+  wakeup(&uart_tx_r);
+  release(&uart_tx_lock);
 }
@@ -0,0 +1,247 @@
+// AF_UNIX stream sockets.
+//
+// A connected pair shares two pipes (see pipe.c), one for each
+// direction: a write copies straight into the peer's ring and
+// wakes the peer directly, with none of the segmentation,
+// checksums or nettimer() polling that loopback TCP pays.
+//
+// Names live in a kernel table rather than the file system:
+// bind() claims one, and connect() finds the listener by it.
+// As for TCP, a listener holds one connection for accept() at a
+// time, in accept_fd; further connect()s wait their turn.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "socklat.h"
+#include "socket.h"
+
+extern struct socket sockets[NSOCK];
+
+// protects names, listener states and accept_fd.
+// lock order: unixlock, then a pipe's lock.
+static struct spinlock unixlock;
+
+void unixinit(void)
+{
+    initlock(&unixlock, "unix");
+}
+
+// find the socket bound to path. caller holds unixlock.
+static struct socket *unixlookup(char *path)
+{
+    for (int i = 0; i < NSOCK; i++) {
+        struct socket *s = &sockets[i];
+        if (s->state != SS_FREE && s->domain == AF_UNIX && s->path[0] != 0 &&
+            strncmp(s->path, path, UNIX_PATH_MAX) == 0)
+            return s;
+    }
+    return 0;
+}
+
+// called from sys_bind()
+// returns 0 on success, or -1 if the name is taken
+int unixbind(struct socket *sock, char *path)
+{
+    if (sock->domain != AF_UNIX || sock->state != SS_UNCONNECTED ||
+        sock->path[0] != 0 || path[0] == 0)
+        return -1;
+
+    acquire(&unixlock);
+    if (unixlookup(path) != 0) {
+        release(&unixlock);
+        return -1;
+    }
+    safestrcpy(sock->path, path, UNIX_PATH_MAX);
+    release(&unixlock);
+    return 0;
+}
+
+// called from socklisten()
+int unixlisten(struct socket *sock)
+{
+    if (sock->path[0] == 0 || sock->state != SS_UNCONNECTED)
+        return -1;
+
+    acquire(&unixlock);
+    sock->state = SS_LISTENING;
+    release(&unixlock);
+    sock->file->readable = 0;
+    sock->file->writable = 0;
+    return 0;
+}
+
+// called from sys_connect()
+// creates the listener's end of the connection in the listener's
+// process, for accept() to return
+// returns 0 on success, or -1 on error
+int unixconnect(struct socket *sock, char *path)
+{
+    struct proc *p = myproc();
+    struct pipe *a = 0, *b = 0;
+    struct socket *l;
+
+    if (sock->domain != AF_UNIX || sock->state != SS_UNCONNECTED)
+        return -1;
+    if ((a = pipecreate()) == 0 || (b = pipecreate()) == 0)
+        goto bad;
+
+    acquire(&unixlock);
+    while (1) {
+        l = unixlookup(path);
+        if (l == 0 || p->killed ||
+            (l->state != SS_LISTENING && l->state != SS_ACCEPTING)) {
+            release(&unixlock);
+            goto bad;
+        }
+        if (l->state == SS_LISTENING)
+            break;
+        // woken by unixaccept() or unixclose()
+        sleep(l, &unixlock);
+    }
+
+    struct socket *ns;
+    int fd = sockalloc(AF_UNIX, SOCK_STREAM, 0, 0, l->owner, &ns);
+    if (fd < 0) {
+        release(&unixlock);
+        goto bad;
+    }
+    ns->rx = a;
+    ns->tx = b;
+    ns->state = SS_CONNECTED;
+    sock->rx = b;
+    sock->tx = a;
+    sock->state = SS_CONNECTED;
+
+    l->accept_fd = fd;
+    l->state = SS_ACCEPTING;
+    wakeup(&l->accept_fd);
+    release(&unixlock);
+
+    sock_poll_wakeup();
+    return 0;
+
+bad:
+    if (a != 0) {
+        pipeclose(a, 0);
+        pipeclose(a, 1);
+    }
+    if (b != 0) {
+        pipeclose(b, 0);
+        pipeclose(b, 1);
+    }
+    return -1;
+}
+
+// called from sockaccept()
+// returns the new socket's fd on success, or -1 on error
+int unixaccept(struct socket *sock, struct sockaddr *addr, int *addrlen, char nonblocking)
+{
+    struct proc *p = myproc();
+
+    acquire(&unixlock);
+    while (sock->state == SS_LISTENING) {
+        if (nonblocking) {
+            release(&unixlock);
+            p->error_no = EAGAIN;
+            return -1;
+        }
+        if (p->killed) {
+            release(&unixlock);
+            return -1;
+        }
+        // woken by unixconnect()
+        sleep(&sock->accept_fd, &unixlock);
+    }
+    if (sock->state != SS_ACCEPTING) {
+        release(&unixlock);
+        return -1;
+    }
+    int fd = sock->accept_fd;
+    sock->accept_fd = -1;
+    sock->state = SS_LISTENING;
+    wakeup(sock);  // the next connect()
+    release(&unixlock);
+
+    if (addr != 0 && addrlen != 0) {
+        memset(addr, 0, sizeof(*addr));
+        addr->sa_family = AF_UNIX;
+        *addrlen = sizeof(struct sockaddr);
+    }
+    return fd;
+}
+
+// called from sockread()
+int unixread(struct socket *sock, uint64 addr, int n, char nonblocking)
+{
+    if (sock->state != SS_CONNECTED)
+        return -1;
+
+    int r = piperead(sock->rx, addr, n, nonblocking);
+    if (r > 0) {
+        sock->bytes_in += r;
+        sock_poll_wakeup();  // the peer may poll for POLLOUT
+    }
+    return r;
+}
+
+// called from sockwrite()
+int unixwrite(struct socket *sock, uint64 addr, int n, char nonblocking)
+{
+    if (sock->state != SS_CONNECTED)
+        return -1;
+
+    int r = pipewrite(sock->tx, addr, n, nonblocking);
+    if (r > 0) {
+        sock->bytes_out += r;
+        sock_poll_wakeup();
+    }
+    return r;
+}
+
+// called from sockpoll(): the events that are ready on sock
+short unixpoll(struct socket *sock, short events)
+{
+    short revents = 0;
+
+    if (sock->state == SS_LISTENING || sock->state == SS_ACCEPTING) {
+        if ((events & POLLIN) && sock->state == SS_ACCEPTING)
+            revents |= POLLIN;
+        return revents;
+    }
+    if (sock->state != SS_CONNECTED)
+        return 0;
+
+    if ((events & POLLIN) && pipereadable(sock->rx))
+        revents |= POLLIN;
+    if ((events & POLLOUT) && pipewritable(sock->tx))
+        revents |= POLLOUT;
+    if (pipeeof(sock->rx))
+        revents |= POLLHUP;
+    return revents;
+}
+
+// called from sockclose()
+void unixclose(struct socket *sock)
+{
+    acquire(&unixlock);
+    if (sock->rx != 0) {
+        // the peer reads EOF, and its writes fail
+        pipeclose(sock->rx, 0);
+        pipeclose(sock->tx, 1);
+        sock->rx = sock->tx = 0;
+    }
+    sock->path[0] = 0;
+    sock->state = SS_FREE;
+    wakeup(sock);  // connect()s waiting on a closed listener
+    release(&unixlock);
+
+    sock_poll_wakeup();
+}
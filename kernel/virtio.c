@@ -0,0 +1,335 @@
+//
+// virtqueues, shared by the virtio disk and net drivers.
+//
+// A queue uses the packed layout if the device offers
+// VIRTIO_F_RING_PACKED, and the split one otherwise; drivers
+// see only buffers. A buffer is a list of up to VIRTQ_MAXSEG
+// pieces that virtq_put() hands to the device with a token,
+// and virtq_get() returns the token once the device is done.
+// With VIRTIO_RING_F_INDIRECT_DESC, a buffer of several pieces
+// takes one descriptor in the ring, pointing at a table of the
+// pieces, so more buffers fit in a queue and the device reads
+// fewer ring entries.
+//
+// the caller serializes calls for a queue, with its own lock.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "virtio.h"
+
+// the address of virtio mmio register r of the device at regs.
+#define REG(regs, r) ((volatile uint32 *)((regs) + (r)))
+#define R(q, r) REG((q)->regs, r)
+
+// Finish feature negotiation with the device at regs, accepting
+// the low 32 feature bits the driver chose, less those virtio.c
+// does not implement, plus the transport features it does, if
+// the device has them. Returns the accepted features, for
+// virtq_init().
+uint64
+virtio_features(uint64 regs, uint32 features)
+{
+  uint32 hi;
+
+  // no used_event or avail_event.
+  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
+
+  *REG(regs, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 1;
+  hi = *REG(regs, VIRTIO_MMIO_DEVICE_FEATURES);
+  hi &= (1 << (VIRTIO_F_VERSION_1 - 32)) | (1 << (VIRTIO_F_RING_PACKED - 32));
+  *REG(regs, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 0;
+
+  *REG(regs, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 1;
+  *REG(regs, VIRTIO_MMIO_DRIVER_FEATURES) = hi;
+  *REG(regs, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 0;
+  *REG(regs, VIRTIO_MMIO_DRIVER_FEATURES) = features;
+
+  return (uint64)hi << 32 | features;
+}
+
+// Set up queue qidx of the device at regs, with num descriptors,
+// in the layout the accepted features call for.
+void
+virtq_init(struct virtq *q, uint64 regs, int qidx, int num, uint64 features)
+{
+  char *pg[3];
+
+  q->regs = regs;
+  q->qidx = qidx;
+  q->num = num;
+  q->packed = (features >> VIRTIO_F_RING_PACKED) & 1;
+  q->indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+
+  *R(q, VIRTIO_MMIO_QUEUE_SEL) = qidx;
+  if(*R(q, VIRTIO_MMIO_QUEUE_READY))
+    panic("virtq_init: queue already in use");
+  uint32 max = *R(q, VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtq_init: queue not available");
+  if(max < num || num > VIRTQ_MAX)
+    panic("virtq_init: queue too short");
+
+  // split: descriptors, avail ring, used ring.
+  // packed: descriptors, driver events, device events.
+  for(int i = 0; i < 3; i++){
+    if((pg[i] = kalloc()) == 0)
+      panic("virtq_init: kalloc failed");
+    memset(pg[i], 0, PGSIZE);
+  }
+  if(q->packed){
+    q->ring = (struct pvirtq_desc *)pg[0];
+  } else {
+    q->desc = (struct virtq_desc *)pg[0];
+    q->avail = (struct virtq_avail *)pg[1];
+    q->used = (struct virtq_used *)pg[2];
+  }
+  if(q->indirect){
+    if((q->ind = (struct virtq_desc *)kalloc()) == 0)
+      panic("virtq_init: kalloc failed");
+    memset(q->ind, 0, PGSIZE);
+  }
+
+  *R(q, VIRTIO_MMIO_QUEUE_NUM) = num;
+  *R(q, VIRTIO_MMIO_QUEUE_DESC_LOW)   = (uint64)pg[0];
+  *R(q, VIRTIO_MMIO_QUEUE_DESC_HIGH)  = (uint64)pg[0] >> 32;
+  *R(q, VIRTIO_MMIO_DRIVER_DESC_LOW)  = (uint64)pg[1];
+  *R(q, VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)pg[1] >> 32;
+  *R(q, VIRTIO_MMIO_DEVICE_DESC_LOW)  = (uint64)pg[2];
+  *R(q, VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)pg[2] >> 32;
+  *R(q, VIRTIO_MMIO_QUEUE_READY) = 1;
+
+  q->used_idx = 0;
+  q->next_avail = q->next_used = 0;
+  q->avail_wrap = q->used_wrap = 1;
+  q->nfree = num;
+  for(int i = 0; i < num; i++)
+    q->free[i] = 1;
+}
+
+// find a free descriptor (split) or id (packed), mark it
+// non-free, return its index.
+static int
+alloc_desc(struct virtq *q)
+{
+  for(int i = 0; i < q->num; i++){
+    if(q->free[i]){
+      q->free[i] = 0;
+      return i;
+    }
+  }
+  panic("virtq: no free descriptor");
+}
+
+// fill in q's indirect table for id with the n pieces of seg.
+// a split table chains its entries; a packed one lists them.
+static uint64
+indirect(struct virtq *q, int id, struct virtq_seg *seg, int n)
+{
+  struct virtq_desc *t = &q->ind[id * VIRTQ_MAXSEG];
+  struct pvirtq_desc *pt = (struct pvirtq_desc *)t;
+
+  for(int i = 0; i < n; i++){
+    if(q->packed){
+      pt[i].addr = seg[i].addr;
+      pt[i].len = seg[i].len;
+      pt[i].id = 0;
+      pt[i].flags = seg[i].write ? VIRTQ_DESC_F_WRITE : 0;
+    } else {
+      t[i].addr = seg[i].addr;
+      t[i].len = seg[i].len;
+      t[i].flags = seg[i].write ? VIRTQ_DESC_F_WRITE : 0;
+      if(i + 1 < n)
+        t[i].flags |= VIRTQ_DESC_F_NEXT;
+      t[i].next = i + 1;
+    }
+  }
+  return (uint64)t;
+}
+
+static int
+put_split(struct virtq *q, struct virtq_seg *seg, int n, int ind, void *data)
+{
+  int idx[VIRTQ_MAXSEG];
+  int ndesc = ind ? 1 : n;
+
+  for(int i = 0; i < ndesc; i++)
+    idx[i] = alloc_desc(q);
+
+  if(ind){
+    q->desc[idx[0]].addr = indirect(q, idx[0], seg, n);
+    q->desc[idx[0]].len = n * sizeof(struct virtq_desc);
+    q->desc[idx[0]].flags = VIRTQ_DESC_F_INDIRECT;
+    q->desc[idx[0]].next = 0;
+  } else {
+    for(int i = 0; i < n; i++){
+      q->desc[idx[i]].addr = seg[i].addr;
+      q->desc[idx[i]].len = seg[i].len;
+      q->desc[idx[i]].flags = seg[i].write ? VIRTQ_DESC_F_WRITE : 0;
+      if(i + 1 < n)
+        q->desc[idx[i]].flags |= VIRTQ_DESC_F_NEXT;
+      q->desc[idx[i]].next = i + 1 < n ? idx[i + 1] : 0;
+    }
+  }
+  q->ndesc[idx[0]] = ndesc;
+  q->data[idx[0]] = data;
+  q->nfree -= ndesc;
+
+  // avail->idx tells the device how far to look in avail->ring.
+  q->avail->ring[q->avail->idx % q->num] = idx[0];
+  __sync_synchronize();
+  q->avail->idx += 1;
+  return 0;
+}
+
+static int
+put_packed(struct virtq *q, struct virtq_seg *seg, int n, int ind, void *data)
+{
+  int id = alloc_desc(q);
+  int ndesc = ind ? 1 : n;
+  int head = q->next_avail;
+  uint16 flags, headflags = 0;
+
+  for(int i = 0; i < ndesc; i++){
+    struct pvirtq_desc *d = &q->ring[q->next_avail];
+    if(ind){
+      d->addr = indirect(q, id, seg, n);
+      d->len = n * sizeof(struct pvirtq_desc);
+      flags = VIRTQ_DESC_F_INDIRECT;
+    } else {
+      d->addr = seg[i].addr;
+      d->len = seg[i].len;
+      flags = seg[i].write ? VIRTQ_DESC_F_WRITE : 0;
+      if(i + 1 < ndesc)
+        flags |= VIRTQ_DESC_F_NEXT;
+    }
+    d->id = id;
+    flags |= q->avail_wrap ? PVIRTQ_DESC_F_AVAIL : PVIRTQ_DESC_F_USED;
+    // the head goes last, so the device sees all or nothing.
+    if(i == 0)
+      headflags = flags;
+    else
+      d->flags = flags;
+
+    if(++q->next_avail == q->num){
+      q->next_avail = 0;
+      q->avail_wrap = !q->avail_wrap;
+    }
+  }
+  q->ndesc[id] = ndesc;
+  q->data[id] = data;
+  q->nfree -= ndesc;
+
+  __sync_synchronize();
+  q->ring[head].flags = headflags;
+  return 0;
+}
+
+// Give the device a buffer made of the n pieces in seg, to be
+// returned with data by virtq_get(). Returns 0, or -1 if the
+// queue is full. The caller then virtq_notify()s the device.
+int
+virtq_put(struct virtq *q, struct virtq_seg *seg, int n, void *data)
+{
+  int ind = q->indirect && n > 1;
+
+  if(n < 1 || n > VIRTQ_MAXSEG || data == 0)
+    panic("virtq_put");
+  if(q->nfree < (ind ? 1 : n))
+    return -1;
+  if(q->packed)
+    return put_packed(q, seg, n, ind, data);
+  return put_split(q, seg, n, ind, data);
+}
+
+// tell the device about new buffers.
+void
+virtq_notify(struct virtq *q)
+{
+  __sync_synchronize();
+  *R(q, VIRTIO_MMIO_QUEUE_NOTIFY) = q->qidx; // value is queue number
+}
+
+// has the device marked the packed descriptor at pos used?
+static int
+used_packed(struct virtq *q, int pos, int wrap)
+{
+  uint16 flags = q->ring[pos].flags;
+
+  return !!(flags & PVIRTQ_DESC_F_AVAIL) == wrap && !!(flags & PVIRTQ_DESC_F_USED) == wrap;
+}
+
+// The token of the k'th buffer the device is done with and
+// virtq_get() has not yet returned, and in *len the bytes the
+// device wrote to it; 0 if there are not that many. Unlike
+// virtq_get(), leaves the buffer in the queue.
+void*
+virtq_peek(struct virtq *q, int k, uint32 *len)
+{
+  int id;
+
+  if(q->packed){
+    int pos = q->next_used, wrap = q->used_wrap;
+    for(;;){
+      if(!used_packed(q, pos, wrap))
+        return 0;
+      __sync_synchronize();
+      id = q->ring[pos].id;
+      if(k-- == 0)
+        break;
+      if((pos += q->ndesc[id]) >= q->num){
+        pos -= q->num;
+        wrap = !wrap;
+      }
+    }
+    if(len)
+      *len = q->ring[pos].len;
+  } else {
+    if((uint16)(q->used->idx - q->used_idx) <= k)
+      return 0;
+    __sync_synchronize();
+    struct virtq_used_elem *e = &q->used->ring[(q->used_idx + k) % q->num];
+    id = e->id;
+    if(len)
+      *len = e->len;
+  }
+  return q->data[id];
+}
+
+// Take the next buffer the device is done with. Returns its
+// token and, in *len, the bytes the device wrote to it; or 0 if
+// the device is not done with any.
+void*
+virtq_get(struct virtq *q, uint32 *len)
+{
+  void *data;
+  int id, i;
+
+  if((data = virtq_peek(q, 0, len)) == 0)
+    return 0;
+
+  if(q->packed){
+    id = q->ring[q->next_used].id;
+    if((q->next_used += q->ndesc[id]) >= q->num){
+      q->next_used -= q->num;
+      q->used_wrap = !q->used_wrap;
+    }
+    q->free[id] = 1;
+  } else {
+    id = q->used->ring[q->used_idx % q->num].id;
+    q->used_idx++;
+    // free the chain.
+    for(i = id; ; i = q->desc[i].next){
+      q->desc[i].addr = 0;
+      q->free[i] = 1;
+      if(!(q->desc[i].flags & VIRTQ_DESC_F_NEXT))
+        break;
+    }
+  }
+  q->nfree += q->ndesc[id];
+  q->data[id] = 0;
+  return data;
+}
@@ -14,7 +14,9 @@
 #define VIRTIO_MMIO_DEVICE_ID           0x008 // device type; 1 is net, 2 is disk
 #define VIRTIO_MMIO_VENDOR_ID           0x00c // 0x554d4551
 #define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014 // which 32 bits of DEVICE_FEATURES
 #define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024 // which 32 bits of DRIVER_FEATURES
 #define VIRTIO_MMIO_QUEUE_SEL           0x030 // select queue, write-only
 #define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034 // max size of current queue, read-only
 #define VIRTIO_MMIO_QUEUE_NUM           0x038 // size of current queue, write-only
@@ -45,6 +47,8 @@
 #define VIRTIO_F_ANY_LAYOUT         27
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
+#define VIRTIO_F_VERSION_1          32
+#define VIRTIO_F_RING_PACKED        34
 
 #define VIRTIO_NET_F_CSUM                 0
 #define VIRTIO_NET_F_GUEST_CSUM           1
@@ -79,6 +83,7 @@ struct virtq_desc {
 };
 #define VIRTQ_DESC_F_NEXT  1 // chained with another descriptor
 #define VIRTQ_DESC_F_WRITE 2 // device writes (vs read)
+#define VIRTQ_DESC_F_INDIRECT 4 // buffer is a table of descriptors
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
@@ -101,6 +106,65 @@ struct virtq_used {
   struct virtq_used_elem ring[];
 };
 
+// a descriptor in a packed ring, from the spec (2.8).
+// the driver makes it available, and the device marks it
+// used, by setting AVAIL and USED to match a wrap counter.
+struct pvirtq_desc {
+  uint64 addr;
+  uint32 len;
+  uint16 id;    // buffer id, returned by the device
+  volatile uint16 flags;
+};
+#define PVIRTQ_DESC_F_AVAIL (1 << 7)
+#define PVIRTQ_DESC_F_USED  (1 << 15)
+
+// a packed ring's event suppression, one for each side;
+// all zeros asks for every notification.
+struct pvirtq_event {
+  uint16 desc;
+  uint16 flags;
+};
+
+// one piece of a buffer, for virtq_put().
+struct virtq_seg {
+  uint64 addr;
+  uint32 len;
+  int write;    // device writes it
+};
+
+#define VIRTQ_MAX 64    // most descriptors in a queue
+#define VIRTQ_MAXSEG 4  // most pieces in a buffer
+
+// a virtqueue, in either layout, for virtio.c.
+// buffers are known by their id: the head descriptor in a
+// split ring; any free id in a packed one.
+struct virtq {
+  uint64 regs;                 // the device's mmio registers
+  int qidx;                    // queue number
+  int num;                     // descriptors
+  int packed;                  // VIRTIO_F_RING_PACKED
+  int indirect;                // VIRTIO_RING_F_INDIRECT_DESC
+
+  // split ring
+  struct virtq_desc *desc;
+  struct virtq_avail *avail;
+  struct virtq_used *used;
+  uint16 used_idx;             // we've looked this far in used->ring
+
+  // packed ring
+  struct pvirtq_desc *ring;
+  uint16 next_avail;           // where the next buffer goes
+  uint16 next_used;            // where the device marks the next used one
+  int avail_wrap;              // wrap counters
+  int used_wrap;
+
+  int nfree;                   // free descriptors
+  char free[VIRTQ_MAX];        // is a descriptor (split) or id (packed) free?
+  uint8 ndesc[VIRTQ_MAX];      // descriptors buffer id takes
+  void *data[VIRTQ_MAX];       // the caller's token for buffer id
+  struct virtq_desc *ind;      // indirect tables, VIRTQ_MAXSEG per id
+};
+
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
 
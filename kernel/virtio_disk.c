@@ -24,34 +24,22 @@
 #define NUM 8
 
 struct disk {
-  // The descriptor table tells the device where to read and write
-  // individual disk operations.
-  struct virtq_desc *desc;
-  // The available ring is where the driver writes descriptor numbers
-  // that the driver would like the device to process (just the head
-  // of each chain). The ring has NUM elements.
-  struct virtq_avail *avail;
-  // The used ring is where the device writes descriptor numbers that
-  // the device has finished processing (just the head of each chain).
-  // The ring has NUM elements.
-  struct virtq_used *used;
-
-  // our own book-keeping.
-  char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used->ring.
+  // the request queue, in the device's choice of layout.
+  // each request is three pieces: type/reserved/sector, the
+  // data, and a 1-byte status result. with indirect
+  // descriptors, that takes one descriptor, so NUM requests
+  // can be in flight, not NUM/3.
+  struct virtq q;
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
-  // indexed by first descriptor index of chain.
-  struct {
+  // one per request; b is 0 if the slot is free.
+  struct req {
     struct buf *b;
     char status;
+    struct virtio_blk_req hdr;   // disk command header
   } info[NUM];
 
-  // disk command headers.
-  // one-for-one with descriptors, for convenience.
-  struct virtio_blk_req ops[NUM];
-  
   struct spinlock vdisk_lock;
 } disk;
 
@@ -63,15 +51,6 @@ virtio_disk_init(void)
 
   initlock(&disk.vdisk_lock, "virtio_disk");
 
-  disk.desc = kalloc();
-  disk.avail = kalloc();
-  disk.used = kalloc();
-  if(!disk.desc || !disk.avail || !disk.used)
-    panic("virtio disk kalloc");
-  memset(disk.desc, 0, PGSIZE);
-  memset(disk.avail, 0, PGSIZE);
-  memset(disk.used, 0, PGSIZE);
-
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 2 ||
      *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
@@ -90,16 +69,16 @@ virtio_disk_init(void)
   status |= VIRTIO_CONFIG_S_DRIVER;
   *R(VIRTIO_MMIO_STATUS) = status;
 
-  // Negotiate features.
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  // Negotiate features. virtio_features() adds the packed
+  // ring, if the device has it.
+  uint32 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  uint64 accepted = virtio_features(VIRTIO0, features);
 
   // Tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -111,29 +90,7 @@ virtio_disk_init(void)
     panic("virtio disk FEATURES_OK unset");
 
   // Initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  if(*R(VIRTIO_MMIO_QUEUE_READY))
-    panic("virtio disk ready not zero");
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
-  if(max == 0)
-    panic("virtio disk has no queue 0");
-  if(max < NUM)
-    panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-
-  *R(VIRTIO_MMIO_QUEUE_DESC_LOW)   = (uint64)disk.desc;
-  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH)  = (uint64)disk.desc >> 32;
-  *R(VIRTIO_MMIO_DRIVER_DESC_LOW)  = (uint64)disk.avail;
-  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
-  *R(VIRTIO_MMIO_DEVICE_DESC_LOW)  = (uint64)disk.used;
-  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
-
-  /* Queue ready. */
-  *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
-
-  // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+  virtq_init(&disk.q, VIRTIO0, 0, NUM, accepted);
 
   // Tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
@@ -142,131 +99,69 @@ virtio_disk_init(void)
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
 
-// find a free descriptor, mark it non-free, return its index.
-static int
-alloc_desc(void)
-{
-  for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
-      return i;
-    }
-  }
-  return -1;
-}
-
-// mark a descriptor as free.
-static void
-free_desc(int i)
+// find a free request slot and room in the queue, and give
+// the device the request in it, for b. caller holds vdisk_lock.
+static struct req*
+submit(struct buf *b, int write)
 {
-  if(i >= NUM)
-    panic("virtio_disk_intr 1");
-  if(disk.free[i])
-    panic("virtio_disk_intr 2");
-  disk.desc[i].addr = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
-}
+  struct req *r;
+  struct virtq_seg seg[3];
 
-// free a chain of descriptors.
-static void
-free_chain(int i)
-{
-  while(1){
-    free_desc(i);
-    if(disk.desc[i].flags & VIRTQ_DESC_F_NEXT)
-      i = disk.desc[i].next;
-    else
+  for(r = disk.info; r < &disk.info[NUM]; r++)
+    if(r->b == 0)
       break;
-  }
-}
+  if(r == &disk.info[NUM])
+    return 0;
 
-static int
-alloc3_desc(int *idx)
-{
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
+  // format the three pieces.
+  // qemu's virtio-blk.c reads them.
+  if(write)
+    r->hdr.type = VIRTIO_BLK_T_OUT; // write the disk
+  else
+    r->hdr.type = VIRTIO_BLK_T_IN; // read the disk
+  r->hdr.reserved = 0;
+  r->hdr.sector = b->blockno * (BSIZE / 512);
+  r->status = 0;
+
+  seg[0].addr = (uint64) &r->hdr;
+  seg[0].len = sizeof(struct virtio_blk_req);
+  seg[0].write = 0;
+  seg[1].addr = (uint64) b->data;
+  seg[1].len = BSIZE;
+  seg[1].write = !write; // device reads or writes b->data
+  seg[2].addr = (uint64) &r->status;
+  seg[2].len = 1;
+  seg[2].write = 1; // device writes the status
+
+  if(virtq_put(&disk.q, seg, 3, r) < 0)
+    return 0;
+
+  // record struct buf for virtio_disk_intr().
+  b->disk = 1;
+  r->b = b;
+  return r;
 }
 
 void
 virtio_disk_rw(struct buf *b, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  struct req *r;
 
   acquire(&disk.vdisk_lock);
 
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-  
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
-
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
-
-  if(write)
-    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
-  else
-    buf0->type = VIRTIO_BLK_T_IN; // read the disk
-  buf0->reserved = 0;
-  buf0->sector = sector;
-
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VIRTQ_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VIRTQ_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VIRTQ_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  // wait for a free slot and room in the queue.
+  while((r = submit(b, write)) == 0)
+    sleep(&disk.q, &disk.vdisk_lock);
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VIRTQ_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
-
-  // avail->idx tells the device how far to look in avail->ring.
-  // avail->ring[...] are desc[] indices the device should process.
-  // we only tell device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
-  __sync_synchronize();
-  disk.avail->idx += 1;
-
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  virtq_notify(&disk.q);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  r->b = 0;
+  wakeup(&disk.q);
 
   release(&disk.vdisk_lock);
 }
@@ -274,21 +169,20 @@ virtio_disk_rw(struct buf *b, int write)
 void
 virtio_disk_intr(void)
 {
-  acquire(&disk.vdisk_lock);
+  struct req *r;
 
-  while((disk.used_idx % NUM) != (disk.used->idx % NUM)){
-    int id = disk.used->ring[disk.used_idx].id;
+  acquire(&disk.vdisk_lock);
 
-    if(disk.info[id].status != 0)
+  // the device may have finished several requests.
+  while((r = virtq_get(&disk.q, 0)) != 0){
+    if(r->status != 0)
       panic("virtio_disk_intr status");
     
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
-
-    disk.used_idx = (disk.used_idx + 1) % NUM;
+    r->b->disk = 0;   // disk is done with buf
+    wakeup(r->b);
   }
+  wakeup(&disk.q);
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
 }
-
@@ -1,10 +1,12 @@
 #include "types.h"
 #include "riscv.h"
 #include "defs.h"
+#include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "virtio.h"
+#include "netstat.h"
 
 #define R(r) ((volatile uint32 *)(VIRTIO1 + (r)))
 
@@ -12,118 +14,66 @@
 // must be a power of two.
 #define NUM 32
 
-struct virtqueue {
-    // The descriptor table tells the device where to read and write
-    // individual operations.
-    struct virtq_desc *desc;
-    // The available ring is where the driver writes descriptor numbers
-    // that the driver would like the device to process (just the head
-    // of each chain). The ring has NUM elements.
-    struct virtq_avail *avail;
-    // The used ring is where the device writes descriptor numbers that
-    // the device has finished processing (just the head of each chain).
-    // The ring has NUM elements.
-    struct virtq_used *used;
-
-    // our own book-keeping.
-    char free[2*NUM];   // is a descriptor free?
-    uint16 used_idx;    // we've looked this far in used->ring.
-
-    // packet headers
-    // one-for-one with descriptors, for convenience.
-    struct virtio_net_hdr ops[NUM];
-};
-
-void mmio_virtq_init(struct virtqueue *q, int qidx) {
-    /* 
-     * MMIO-specific initialization
-     * check spec 4.2.3.2 Virtqueue Configuration
-     */
-    
-    // 1. select a queue by writing to queuesel
-    *R(VIRTIO_MMIO_QUEUE_SEL) = qidx;
-    
-    // 2. check if the queue is already in use
-    if(*R(VIRTIO_MMIO_QUEUE_READY))
-        panic("virtq_init: queue already in use");
-    
-    // 3. check if the queue is available (queue-num-max != 0)
-    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
-    if(max == 0) panic("virtq_init: queue not available");
-    if(max < NUM) panic("virtq_init: queue too short");
-
-    // 4. allocate and zero the queue memory
-    q->desc = (struct virtq_desc *)kalloc();
-    q->avail = (struct virtq_avail *)kalloc();
-    q->used = (struct virtq_used *)kalloc();
-    
-    if (!q->desc || !q->avail || !q->used)
-        panic("virtq_init: kalloc failed");
-
-    memset(q->desc, 0, PGSIZE);
-    memset(q->avail, 0, PGSIZE);
-    memset(q->used, 0, PGSIZE);
-
-    // 5. notify the device about the queue size
-    *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-    if (qidx == 0) // RX queue
-        *R(VIRTIO_MMIO_QUEUE_NUM) = 2*NUM;
-
-    // 6. write PA of three parts of the queue to the device
-    *R(VIRTIO_MMIO_QUEUE_DESC_LOW)   = (uint64)q->desc;
-    *R(VIRTIO_MMIO_QUEUE_DESC_HIGH)  = (uint64)q->desc >> 32;
-    *R(VIRTIO_MMIO_DRIVER_DESC_LOW)  = (uint64)q->avail;
-    *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)q->avail >> 32;
-    *R(VIRTIO_MMIO_DEVICE_DESC_LOW)  = (uint64)q->used;
-    *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)q->used >> 32;
+// RX buffers are half a page, two to each page of recv_buf, one
+// for each of the 2*NUM RX descriptors. The device writes a
+// frame's header at the start of its first buffer; with
+// MRG_RXBUF, a frame too long for one buffer continues in the
+// next ones.
+#define RXBUFSZ (PGSIZE / 2)
 
-    // 7. tell the device that the queue is ready
-    *R(VIRTIO_MMIO_QUEUE_READY) = 1;
+// send pages a frame can take: a jumbo frame and its header.
+#define TXMAXPG 3
 
-
-    /* 
-     * initialize book-keeping 
-     */
-    for(int i = 0; i < 2*NUM; i++)
-        q->free[i] = 1;
-    q->used_idx = 0;
-}
+// a frame the device is sending: the send pages holding it.
+struct txframe {
+    int npages;
+    int page[TXMAXPG];
+};
 
 struct net {
-    struct virtqueue rx;
-    struct virtqueue tx;
+    // the queues, in the device's choice of layout (see virtio.c).
+    struct virtq rx;
+    struct virtq tx;
     void  *send_buf[NUM];
-    void  *recv_buf[NUM];
+    char   send_busy[NUM];      // is a send page in use?
+    struct txframe txframe[NUM]; // indexed by a frame's first page
+    void  *recv_buf[NUM];   // RX buffers 2*i and 2*i+1
     struct spinlock vnet_lock;
-} net;
 
-static void 
-fill_rx(int i) {
-    struct virtio_net_hdr *hdr = &net.rx.ops[i];
-
-    // header is populated by the device
-    // we don't fill it here
+    // statistics, protected by vnet_lock
+    uint64 rx_frames;
+    uint64 rx_bytes;
+    uint64 tx_frames;
+    uint64 tx_bytes;
+    uint64 tx_ring_full;
+} net;
 
-    net.rx.desc[2*i].addr = (uint64)hdr;
-    net.rx.desc[2*i].len = sizeof(struct virtio_net_hdr);
-    net.rx.desc[2*i].flags = VIRTQ_DESC_F_WRITE | VIRTQ_DESC_F_NEXT;
-    net.rx.desc[2*i].next = 2*i+1;
+// RX buffer i.
+static char *rxbuf(int i) {
+    return (char *)net.recv_buf[i / 2] + (i % 2) * RXBUFSZ;
+}
 
-    net.rx.desc[2*i+1].addr = (uint64)net.recv_buf[i];
-    net.rx.desc[2*i+1].len = PGSIZE;
-    net.rx.desc[2*i+1].flags = VIRTQ_DESC_F_WRITE;  // device writes to this buffer
-    net.rx.desc[2*i+1].next = 0;                    // VIRTQ_DESC_F_NEXT not set: no chaining
+// give an RX buffer to the device.
+// the caller notifies the device.
+static void 
+fill_rx(char *buf) {
+    struct virtq_seg seg;
 
-    net.rx.avail->ring[net.rx.avail->idx % (2 * NUM)] = 2*i;
-    __sync_synchronize();
-    net.rx.avail->idx++;
+    seg.addr = (uint64)buf;
+    seg.len = RXBUFSZ;
+    seg.write = 1;  // device writes to this buffer
 
-    // notify the device
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;  // queue number of RX
+    // there is a descriptor for every RX buffer
+    if (virtq_put(&net.rx, &seg, 1, buf) < 0)
+        panic("fill_rx");
 }
 
-/* initialize the NIC and store the MAC address */
-void virtio_net_init(void *mac) {
+/*
+ * initialize the NIC and store the MAC address.
+ * returns the MTU to use: the device's, if it has one,
+ * but no more than maxmtu; otherwise 1500.
+ */
+int virtio_net_init(void *mac, int maxmtu) {
     uint32 status = 0;
 
     initlock(&net.vnet_lock, "virtio_net");
@@ -155,7 +105,8 @@ void virtio_net_init(void *mac) {
     status |= VIRTIO_CONFIG_S_DRIVER;
     *R(VIRTIO_MMIO_STATUS) = status;
 
-    // Negotiate features.
+    // Negotiate features. virtio_features() adds the packed
+    // ring, if the device has it.
     // spec 5.1.3 Feature bits
     uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
     if (!(features & (1 << VIRTIO_NET_F_MAC)) || 
@@ -189,7 +140,16 @@ void virtio_net_init(void *mac) {
 
     features &= ~(1 << VIRTIO_NET_F_MQ);
 
-    *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+    // spec 5.1.4.1: the device never sends frames bigger than its
+    // MTU, and the driver must not either once it accepts it.
+    // frames spanning several RX buffers are merged (MRG_RXBUF).
+    int mtu = 1500;
+    if (features & (1 << VIRTIO_NET_F_MTU)) {
+        struct virtio_net_config *cfg = (struct virtio_net_config *)R(VIRTIO_MMIO_CONFIG);
+        mtu = cfg->mtu < maxmtu ? cfg->mtu : maxmtu;
+    }
+
+    uint64 accepted = virtio_features(VIRTIO1, features);
 
     // Tell device that feature negotiation is complete.
     status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -207,8 +167,8 @@ void virtio_net_init(void *mac) {
     
     // 1. identify and initialize the virtqueues
     // queue idx: spec 5.1.2 Virtqueues
-    mmio_virtq_init(&net.rx, 0);
-    mmio_virtq_init(&net.tx, 1);
+    virtq_init(&net.rx, VIRTIO1, 0, 2 * NUM, accepted);
+    virtq_init(&net.tx, VIRTIO1, 1, NUM, accepted);
     
     for (int i = 0; i < NUM; i++) {
         net.send_buf[i] = kalloc();
@@ -225,8 +185,9 @@ void virtio_net_init(void *mac) {
     // 2. fill receive queue with buffers
     // 5.1.6.3 Setting Up Receive Buffers
     // 2.6.5 The Virtqueue Descriptor Table
-    for (int i = 0; i < NUM; i++)
-        fill_rx(i);
+    for (int i = 0; i < 2 * NUM; i++)
+        fill_rx(rxbuf(i));
+    virtq_notify(&net.rx);
 
     // 3. read and store the MAC address
     // spec 2.4.1 Driver Requirements: Device Configuration Space
@@ -243,67 +204,49 @@ void virtio_net_init(void *mac) {
     // Tell device we're completely ready.
     status |= VIRTIO_CONFIG_S_DRIVER_OK;
     *R(VIRTIO_MMIO_STATUS) = status;
-}
 
-// find a free descriptor, mark it non-free, return its index.
-static int
-alloc_desc(struct virtqueue *q)
-{
-  for(int i = 0; i < NUM; i++){
-    if(q->free[i]){
-        q->free[i] = 0;
-        return i;
-    }
-  }
-  return -1;
+    return mtu;
 }
 
-// mark a descriptor as free.
-static void
-free_desc(struct virtqueue *q, int i)
-{
-  if(i >= NUM)
-    panic("free_desc: out of range");
-  if(q->free[i])
-    panic("free_desc: double free");
-  q->desc[i].addr = 0;
-  q->free[i] = 1;
+// free the send pages of frames the device has sent.
+// caller holds vnet_lock.
+static void tx_reclaim(void) {
+    struct txframe *f;
+
+    while ((f = virtq_get(&net.tx, 0)) != 0)
+        for (int i = 0; i < f->npages; i++)
+            net.send_busy[f->page[i]] = 0;
 }
 
 /* send data; return 0 on success */
 // spec 5.1.6.2 Packet Transmission
 int virtio_net_send(const void *data, int len) {
-    acquire(&net.vnet_lock);
-
-    // if the available ring is full, drop the packet
-    // avail->idx and used->idx are only increased (no modulo)
-    if (net.tx.avail->idx - net.tx.used->idx == NUM) {
-        printf("virtio_net_send: ring full\n");
-        release(&net.vnet_lock);
+    // header and data fill as many send pages as they need,
+    // each a piece of one buffer: a jumbo frame takes three.
+    int hdrlen = sizeof(struct virtio_net_hdr);
+    int npages = (hdrlen + len + PGSIZE - 1) / PGSIZE;
+    struct virtq_seg seg[TXMAXPG];
+    struct txframe *f;
+    int page[TXMAXPG], n = 0;
+
+    if (npages > TXMAXPG)
         return -1;
-    }
 
-    // first free all used descriptors
-    while (net.tx.used->idx > net.tx.used_idx) {
-        struct virtq_used_elem *e = &net.tx.used->ring[net.tx.used_idx % NUM];
-        free_desc(&net.tx, e->id);
-        net.tx.used_idx++;
-    }
+    acquire(&net.vnet_lock);
 
-    // allocate one descriptor for header + data
-    int idx = 0;
-    if ((idx = alloc_desc(&net.tx)) < 0) {
-        printf("virtio_net_send: no available descriptor\n");
-        printf("virtio_net_send: avail->idx = %d, used->idx = %d, used_idx = %d\n", net.tx.avail->idx, net.tx.used->idx, net.tx.used_idx);
-        release(&net.vnet_lock);
-        return -1;
-    }
+    // first free the pages of frames already sent
+    tx_reclaim();
 
-    // get preallocated buffer by idx
-    void *buf = net.send_buf[idx];
+    // allocate the send pages for header + data
+    for (int i = 0; i < NUM && n < npages; i++)
+        if (!net.send_busy[i])
+            page[n++] = i;
+    if (n < npages)
+        goto full;
+    f = &net.txframe[page[0]];
 
     // fill in the header fields
-    struct virtio_net_hdr *hdr = buf;
+    struct virtio_net_hdr *hdr = net.send_buf[page[0]];
     hdr->flags = 0;             // assume the packet is completely checksummed
     hdr->csum_start = 0;        // unused
     hdr->csum_offset = 0;       // unused
@@ -312,107 +255,183 @@ int virtio_net_send(const void *data, int len) {
     hdr->gso_size = 0;          // unused
     hdr->num_buffers = 0;       // driver must set num_buffers to 0
 
-    // copy user data to the payload area
-    void *payload = (void *)hdr + sizeof(struct virtio_net_hdr);
-    memmove(payload, data, len);
-
-    // fill in the fields of the descriptor
-    net.tx.desc[idx].addr = (uint64)hdr;
-    net.tx.desc[idx].len = sizeof(struct virtio_net_hdr) + len;
-    net.tx.desc[idx].flags = 0;     // read-only
-    net.tx.desc[idx].next = 0;      // device only reads from this buffer
+    // copy user data to the payload area, and describe the pieces
+    int off = hdrlen, left = len;
+    for (int i = 0; i < npages; i++) {
+        int m = PGSIZE - off < left ? PGSIZE - off : left;
+        memmove(net.send_buf[page[i]] + off, data, m);
+        data += m;
+        left -= m;
+
+        seg[i].addr = (uint64)net.send_buf[page[i]];
+        seg[i].len = off + m;
+        seg[i].write = 0;       // device only reads from this buffer
+        f->page[i] = page[i];
+        off = 0;
+    }
+    f->npages = npages;
 
-    // update the available ring
-    net.tx.avail->ring[net.tx.avail->idx % NUM] = idx;
-    __sync_synchronize();  // TODO: why?
-    net.tx.avail->idx++;
+    if (virtq_put(&net.tx, seg, npages, f) < 0)
+        goto full;
+    for (int i = 0; i < npages; i++)
+        net.send_busy[page[i]] = 1;
 
     // notify the device
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 1;  // queue number of TX
+    virtq_notify(&net.tx);
+
+    net.tx_frames++;
+    net.tx_bytes += len;
 
     // if called during initialization, wait for the device to process the packet
     if (myproc() == 0) {
         // should not sleep because interrupt is disabled
-        // user->idx is incremented by the device
-        while (net.tx.used->idx == net.tx.used_idx)
+        // the device marks the buffer used
+        while (virtq_peek(&net.tx, 0, 0) == 0)
             ;
-
-        struct virtq_used_elem *e = &net.tx.used->ring[net.tx.used_idx % NUM];
-        free_desc(&net.tx, e->id);
-        net.tx.used_idx++;
+        tx_reclaim();
     }
 
     release(&net.vnet_lock);
     
     return 0;
+
+full:
+    // no pages or descriptors left: drop the packet
+    printf("virtio_net_send: ring full\n");
+    net.tx_ring_full++;
+    release(&net.vnet_lock);
+    return -1;
+}
+
+// length of the frame at the head of the used ring and the number
+// of buffers it takes, or 0 if there is none yet.
+// caller holds vnet_lock.
+static int rxframe(int *nbuf) {
+    struct virtio_net_hdr *hdr;
+    uint32 blen;
+    int n, len;
+
+    if ((hdr = virtq_peek(&net.rx, 0, &blen)) == 0)
+        return 0;
+    n = hdr->num_buffers;
+    if (n < 1 || n > 2 * NUM)
+        panic("virtio_net: bad num_buffers");
+
+    len = 0;
+    for (int i = 0; i < n; i++) {
+        if (virtq_peek(&net.rx, i, &blen) == 0)
+            return 0;   // the rest is not there yet
+        len += blen;
+    }
+    *nbuf = n;
+    return len - sizeof(struct virtio_net_hdr);
 }
 
-/* receive data; return the number of bytes received */
+/* length of the next received frame, or 0 if there is none yet */
+int virtio_net_rxlen(void) {
+    int len, nbuf;
+
+    acquire(&net.vnet_lock);
+    len = rxframe(&nbuf);
+    release(&net.vnet_lock);
+    return len;
+}
+
+/*
+ * copy len bytes from offset off of the next received frame to
+ * data, which lets the caller spread the frame over several
+ * buffers; return the number of bytes copied.
+ * the frame stays in the ring until virtio_net_rxdone().
+ */
 // spec 5.1.6.4 Processing of Incoming Packets
-int virtio_net_recv(void *data, int len) {
+int virtio_net_rxcopy(void *data, int off, int len) {
     acquire(&net.vnet_lock);
 
-    // return immediately if there is no packet to receive
-    if (net.rx.used->idx == net.rx.used_idx) {
+    int nbuf, copied = 0;
+    if (rxframe(&nbuf) == 0) {
         release(&net.vnet_lock);
         return 0;
     }
 
-    // get received packet
-    int hdr_idx, data_idx, data_len;
-    struct virtq_used_elem *used;
-    void *data_ptr;
+    // the header comes before the data of the first buffer only
+    int start = sizeof(struct virtio_net_hdr);
+    for (int b = 0; b < nbuf && copied < len; b++) {
+        uint32 blen;
+        char *buf = virtq_peek(&net.rx, b, &blen);
+        int n = blen - start;                               // data in this buffer
+        if (off >= n) {
+            off -= n;
+        } else {
+            if (n - off > len - copied)
+                n = len - copied + off;
+            memmove(data + copied, buf + start + off, n - off);
+            copied += n - off;
+            off = 0;
+        }
+        start = 0;
+    }
+
+    release(&net.vnet_lock);
 
-    used = &net.rx.used->ring[net.rx.used_idx % (2 * NUM)];
-    hdr_idx = used->id;                                     // index of the header descriptor
-    data_idx = net.rx.desc[hdr_idx].next;                   // index of the data descriptor
-    data_ptr = (void *)net.rx.desc[data_idx].addr;          // address of the data
-    data_len = used->len - sizeof(struct virtio_net_hdr);   // length of the data
+    return copied;
+}
 
-    // copy the data to the user buffer
-    memmove(data, data_ptr, data_len);
+/* done with the next received frame: give its buffers back */
+void virtio_net_rxdone(void) {
+    acquire(&net.vnet_lock);
 
-    // update bookkeeping info
-    net.rx.used_idx++;
+    int nbuf, data_len;
+    if ((data_len = rxframe(&nbuf)) == 0) {
+        release(&net.vnet_lock);
+        return;
+    }
 
     // refill RX and notify the device
-    // reuse the descriptor chain, no need to free and allocate it
-    fill_rx(hdr_idx/2);
+    // reuse the descriptors, no need to free and allocate them
+    for (int b = 0; b < nbuf; b++)
+        fill_rx(virtq_get(&net.rx, 0));
+    virtq_notify(&net.rx);
+
+    // update bookkeeping info
+    net.rx_frames++;
+    net.rx_bytes += data_len;
 
     release(&net.vnet_lock);
-    
-    return data_len;
 }
 
-// TODO: somehow this function is never called after the initialization
-// will be called in trap.c devintr()
+// called in trap.c devintr(). without VIRTIO_RING_F_EVENT_IDX,
+// the device interrupts for every buffer it uses.
 void
 virtio_net_intr(void)
 {
-    printf("virtio_net_intr\n");
     acquire(&net.vnet_lock);
 
-    // only handle Used Buffer Notification (0x1) for now
-    if (!(*R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x1)) {
-        panic("virtio_net_intr: Configuration Change Notification");
-    }
-
     // incoming packet: wake up potential waiters
-    if (net.rx.used->idx > net.rx.used_idx) {
-        // descriptor chain is freed in virtio_net_recv()
+    if (virtq_peek(&net.rx, 0, 0)) {
+        // buffers are given back in virtio_net_rxdone()
         wakeup(&net.rx);
         // Also wake up poll waiters
         sock_poll_wakeup();
     }
 
-    // outgoing packet: free descriptors and do some bookkeeping
-    if (net.tx.used->idx > net.tx.used_idx) {
-        free_desc(&net.tx, net.tx.used->ring[net.tx.used_idx % NUM].id);
-        net.tx.used_idx++;
-    }
+    // outgoing packets: free their pages
+    tx_reclaim();
 
-    // acknowledge the interrupt
+    // acknowledge the interrupt; configuration changes
+    // (0x2), e.g. of the link status, need nothing.
     *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
     release(&net.vnet_lock);
-}
\ No newline at end of file
+}
+// copy the driver's counters into ns.
+void
+virtio_net_stats(struct netstat *ns)
+{
+    acquire(&net.vnet_lock);
+    ns->rx_frames = net.rx_frames;
+    ns->rx_bytes = net.rx_bytes;
+    ns->tx_frames = net.tx_frames;
+    ns->tx_bytes = net.tx_bytes;
+    ns->tx_ring_full = net.tx_ring_full;
+    release(&net.vnet_lock);
+}
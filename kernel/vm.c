@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -15,6 +17,10 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// bumped whenever a page-table page is freed, which
+// invalidates every process's walkcache.
+static uint walkgen;
+
 void print(pagetable_t);
 
 /*
@@ -158,8 +164,10 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove mappings from a page table. The mappings in
-// the given range must exist. Optionally free the
-// physical memory.
+// the given range must exist, unless the physical memory
+// is to be freed too: pages of a program image that were
+// never touched have none. Shared image pages belong to
+// their text and are not freed.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 size, int do_free)
 {
@@ -169,24 +177,27 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 size, int do_free)
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
-  for(;;){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0){
+  for(;; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0){
+      if(do_free){
+        if(a == last)
+          break;
+        continue;
+      }
+      if(pte == 0)
+        panic("uvmunmap: walk");
       printf("va=%p pte=%p\n", a, *pte);
       panic("uvmunmap: not mapped");
     }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
-    if(do_free){
+    if(do_free && (*pte & PTE_TEXT) == 0){
       pa = PTE2PA(*pte);
       kfree((void*)pa);
     }
     *pte = 0;
     if(a == last)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
   }
 }
 
@@ -280,6 +291,7 @@ freewalk(pagetable_t pagetable)
       panic("freewalk: leaf");
     }
   }
+  __sync_fetch_and_add(&walkgen, 1);
   kfree((void*)pagetable);
 }
 
@@ -295,7 +307,9 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory, except for shared program
+// image pages, which the child shares too, and
+// untouched ones, which it maps on demand as well.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -307,12 +321,15 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_TEXT){
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -341,27 +358,170 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Handle a page fault by the current process at va, for an
+// access that needs perm (PTE_R, PTE_W or PTE_X): map the page
+// of the program image that exec() left for the first touch,
+// or give the process its own copy of a shared image page it
+// writes to. Returns 0 if the access can be retried, -1 if it
+// is a real fault.
+int
+uvmfault(uint64 va, int perm)
+{
+  struct vmspace *vm = myproc()->vm;
+  char *mem, *src;
+  pte_t *pte;
+  int r = -1;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+
+  acquire(&vm->lock);
+  if((pte = walk(vm->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    if((*pte & PTE_U) == 0)
+      goto out;
+    if((*pte & perm) == perm){
+      // another thread mapped it first, or the TLB was stale.
+      r = 0;
+    } else if(perm == PTE_W && (*pte & PTE_TEXT)){
+      if((mem = kalloc()) == 0)
+        goto out;
+      memmove(mem, (char*)PTE2PA(*pte), PGSIZE);
+      *pte = PA2PTE(mem) | PTE_V | PTE_R | PTE_W | PTE_X | PTE_U;
+      r = 0;
+    }
+  } else if(vm->text && va < vm->sz && va < textsize(vm->text)){
+    src = textpage(vm->text, va);
+    if(src && perm != PTE_W && vm->ref == 1){
+      r = mappages(vm->pagetable, va, PGSIZE, (uint64)src,
+                   PTE_R | PTE_X | PTE_U | PTE_TEXT);
+    } else if((mem = kalloc()) != 0){
+      if(src)
+        memmove(mem, src, PGSIZE);
+      else
+        memset(mem, 0, PGSIZE);
+      if((r = mappages(vm->pagetable, va, PGSIZE, (uint64)mem,
+                       PTE_R | PTE_W | PTE_X | PTE_U)) < 0)
+        kfree(mem);
+    }
+  }
+ out:
+  release(&vm->lock);
+  sfence_vma();
+  return r;
+}
+
+// Give the address space a private copy of each shared
+// program image page mapped below sz, before a second
+// thread starts to use it. Returns 0, or -1 if out of memory.
+int
+uvmprivate(pagetable_t pagetable, uint64 sz)
+{
+  pte_t *pte;
+  char *mem;
+
+  for(uint64 va = 0; va < sz; va += PGSIZE){
+    if((pte = walk(pagetable, va, 0)) == 0 || (*pte & PTE_TEXT) == 0)
+      continue;
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)PTE2PA(*pte), PGSIZE);
+    *pte = PA2PTE(mem) | PTE_V | PTE_R | PTE_W | PTE_X | PTE_U;
+  }
+  sfence_vma();
+  return 0;
+}
+
+// Like walkaddr(), for copyin/copyout/copyinstr on behalf of
+// the current process. Remembers the level-0 page-table page of
+// the last lookup, so the pages of a buffer that lie in the same
+// 2-megabyte region cost one PTE load instead of a full walk.
+// PTEs are always read live; only the table page is cached, and
+// freewalk() invalidates it by bumping walkgen.
+// Faults in pages of the program image as the CPU would,
+// with a private copy if the kernel is going to write.
+static uint64
+walkcached(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct walkcache *wc;
+  pte_t *pte;
+  int faulted = 0;
+
+  if(va >= MAXVA)
+    return 0;
+
+  if(p == 0 || p->pagetable != pagetable)
+    return walkaddr(pagetable, va);
+
+  wc = &p->walkcache;
+ again:
+  if(wc->pagetable == pagetable && wc->region == (va >> PXSHIFT(1)) &&
+     wc->gen == walkgen){
+    pte = &wc->l0[PX(0, va)];
+  } else {
+    wc->gen = walkgen;
+    if((pte = walk(pagetable, va, 0)) == 0){
+      wc->pagetable = 0;
+    } else {
+      wc->pagetable = pagetable;
+      wc->region = va >> PXSHIFT(1);
+      wc->l0 = pte - PX(0, va);
+    }
+  }
+
+  if(pte == 0 || (*pte & PTE_V) == 0 || (write && (*pte & PTE_TEXT))){
+    if(faulted || uvmfault(va, write ? PTE_W : PTE_R) < 0)
+      return 0;
+    faulted = 1;
+    goto again;
+  }
+  if((*pte & PTE_U) == 0)
+    return 0;
+  return PTE2PA(*pte);
+}
+
+// Translate user address va for a copy of up to len bytes.
+// Returns the physical address, or 0 if va is not mapped, and
+// sets *n to how many bytes from va on (at most len) are
+// physically contiguous, so they can be moved with one memmove().
+// write says the copy stores to them.
+static uint64
+uvmrange(pagetable_t pagetable, uint64 va, uint64 len, uint64 *n, int write)
+{
+  uint64 va0, pa0, pa;
+
+  va0 = PGROUNDDOWN(va);
+  if((pa0 = walkcached(pagetable, va0, write)) == 0)
+    return 0;
+  pa = pa0 + (va - va0);
+  *n = PGSIZE - (va - va0);
+  while(*n < len && walkcached(pagetable, va0 + PGSIZE, write) == pa0 + PGSIZE){
+    va0 += PGSIZE;
+    pa0 += PGSIZE;
+    *n += PGSIZE;
+  }
+  if(*n > len)
+    *n = len;
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 n, pa;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa = uvmrange(pagetable, dstva, len, &n, 1)) == 0)
       return -1;
-    n = PGSIZE - (dstva - va0);
-    if(n > len)
-      n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+    memmove((void *)pa, src, n);
 
     len -= n;
     src += n;
-    dstva = va0 + PGSIZE;
+    dstva += n;
   }
   return 0;
 }
@@ -372,21 +532,16 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  uint64 n, pa;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa = uvmrange(pagetable, srcva, len, &n, 0)) == 0)
       return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > len)
-      n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    memmove(dst, (void *)pa, n);
 
     len -= n;
     dst += n;
-    srcva = va0 + PGSIZE;
+    srcva += n;
   }
   return 0;
 }
@@ -403,7 +558,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkcached(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
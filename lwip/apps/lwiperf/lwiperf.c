@@ -710,10 +710,13 @@ static err_t lwiperf_start_tcp_server_impl(const ip_addr_t *local_addr, u16_t lo
 
   pcb = tcp_new_ip_type(LWIPERF_SERVER_IP_TYPE);
   if (pcb == NULL) {
+    LWIPERF_FREE(lwiperf_state_tcp_t, s);
     return ERR_MEM;
   }
   err = tcp_bind(pcb, local_addr, local_port);
   if (err != ERR_OK) {
+    tcp_close(pcb);
+    LWIPERF_FREE(lwiperf_state_tcp_t, s);
     return err;
   }
   s->server_pcb = tcp_listen_with_backlog(pcb, 1);
@@ -819,21 +822,18 @@ void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
 void
 lwiperf_abort(void *lwiperf_session)
 {
-  lwiperf_state_base_t *i, *dealloc, *last = NULL;
+  lwiperf_state_base_t *i, *next;
 
   LWIP_ASSERT_CORE_LOCKED();
 
-  for (i = lwiperf_all_connections; i != NULL; ) {
+  /* close the pcbs too, and unlink through lwiperf_list_remove(), which
+     also handles the head of the list */
+  for (i = lwiperf_all_connections; i != NULL; i = next) {
+    next = i->next;
     if ((i == lwiperf_session) || (i->related_master_state == lwiperf_session)) {
-      dealloc = i;
-      i = i->next;
-      if (last != NULL) {
-        last->next = i;
-      }
-      LWIPERF_FREE(lwiperf_state_tcp_t, dealloc); /* @todo: type? */
-    } else {
-      last = i;
-      i = i->next;
+      lwiperf_state_tcp_t *conn = (lwiperf_state_tcp_t *)i;
+      conn->report_fn = NULL;
+      lwiperf_tcp_close(conn, LWIPERF_TCP_ABORTED_LOCAL);
     }
   }
 }
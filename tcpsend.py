@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+"""
+Send the byte pattern "tcptest -l" checks to xv6.
+
+usage: python3 tcpsend.py [host [port [bytes]]]
+
+With QEMU's user networking the default localhost:5001 is forwarded
+to port 5001 in xv6. With "make TAP=tap0", give xv6's own address,
+10.0.2.15, after configuring the tap, for example:
+
+    ip addr add 10.0.2.2/24 dev tap0
+    ip link set tap0 mtu 9000 up
+"""
+
+import socket
+import sys
+
+HOST = sys.argv[1] if len(sys.argv) > 1 else 'localhost'
+PORT = int(sys.argv[2]) if len(sys.argv) > 2 else 5001
+NBYTES = int(sys.argv[3]) if len(sys.argv) > 3 else 16 * 1024 * 1024
+
+def main():
+    # the pattern repeats every 251 * 8192 bytes
+    chunk = bytes(i % 251 for i in range(251 * 8192))
+    with socket.create_connection((HOST, PORT)) as s:
+        sent = 0
+        while sent < NBYTES:
+            n = min(len(chunk), NBYTES - sent)
+            s.sendall(chunk[:n])
+            sent += n
+        s.shutdown(socket.SHUT_WR)
+        s.recv(1)  # wait for xv6 to close
+    print(f"sent {sent} bytes")
+
+if __name__ == "__main__":
+    main()
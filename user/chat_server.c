@@ -15,6 +15,7 @@
 #include "kernel/param.h"
 #include "kernel/types.h"
 #include "kernel/spinlock.h"
+#include "kernel/socklat.h"
 #include "kernel/socket.h"
 #include "user/user.h"
 
@@ -121,31 +122,8 @@ void handle_new_connection(void) {
     clients[slot].addr = client_addr.sin_addr;
     clients[slot].port = client_addr.sin_port;
     
-    // Generate default name
-    char name_buf[32];
-    // Simple name generation using slot number
-    strcpy(name_buf, "user");
-    // Convert slot to string and append
-    char slot_str[8];
-    int temp = slot;
-    int j = 0;
-    do {
-        slot_str[j++] = '0' + (temp % 10);
-        temp /= 10;
-    } while (temp > 0);
-    slot_str[j] = '\0';
-    // Reverse the string
-    for (int k = 0; k < j / 2; k++) {
-        char c = slot_str[k];
-        slot_str[k] = slot_str[j - 1 - k];
-        slot_str[j - 1 - k] = c;
-    }
-    // Append to name
-    int name_len = strlen(name_buf);
-    for (int k = 0; k <= j; k++) {
-        name_buf[name_len + k] = slot_str[k];
-    }
-    strcpy(clients[slot].name, name_buf);
+    // Generate default name from the slot number
+    snprintf(clients[slot].name, sizeof(clients[slot].name), "user%d", slot);
     
     num_clients++;
     
@@ -156,27 +134,14 @@ void handle_new_connection(void) {
     
     // Send welcome message
     char welcome[128];
-    strcpy(welcome, "Welcome to xv6 Chat Server! Your name is: ");
-    int wlen = strlen(welcome);
-    for (int k = 0; clients[slot].name[k]; k++) {
-        welcome[wlen++] = clients[slot].name[k];
-    }
-    welcome[wlen++] = '\n';
-    welcome[wlen] = '\0';
+    int wlen = snprintf(welcome, sizeof(welcome),
+                        "Welcome to xv6 Chat Server! Your name is: %s\n", clients[slot].name);
     write(client_fd, welcome, wlen);
     
     // Broadcast join message
     char join_msg[128];
-    strcpy(join_msg, "*** ");
-    int jlen = 4;
-    for (int k = 0; clients[slot].name[k]; k++) {
-        join_msg[jlen++] = clients[slot].name[k];
-    }
-    char *joined = " has joined the chat ***\n";
-    for (int k = 0; joined[k]; k++) {
-        join_msg[jlen++] = joined[k];
-    }
-    join_msg[jlen] = '\0';
+    int jlen = snprintf(join_msg, sizeof(join_msg), "*** %s has joined the chat ***\n",
+                        clients[slot].name);
     broadcast_message(join_msg, jlen, slot);
 }
 
@@ -188,16 +153,8 @@ void handle_client_data(int slot) {
     if (n <= 0) {
         // Client disconnected or error
         char leave_msg[128];
-        strcpy(leave_msg, "*** ");
-        int llen = 4;
-        for (int k = 0; clients[slot].name[k]; k++) {
-            leave_msg[llen++] = clients[slot].name[k];
-        }
-        char *left = " has left the chat ***\n";
-        for (int k = 0; left[k]; k++) {
-            leave_msg[llen++] = left[k];
-        }
-        leave_msg[llen] = '\0';
+        int llen = snprintf(leave_msg, sizeof(leave_msg), "*** %s has left the chat ***\n",
+                            clients[slot].name);
         
         int slot_save = slot;
         remove_client(slot);
@@ -222,24 +179,8 @@ void handle_client_data(int slot) {
         
         // Broadcast name change
         char name_msg[128];
-        strcpy(name_msg, "*** ");
-        int mlen = 4;
-        for (int k = 0; old_name[k]; k++) {
-            name_msg[mlen++] = old_name[k];
-        }
-        char *changed = " is now known as ";
-        for (int k = 0; changed[k]; k++) {
-            name_msg[mlen++] = changed[k];
-        }
-        for (int k = 0; clients[slot].name[k]; k++) {
-            name_msg[mlen++] = clients[slot].name[k];
-        }
-        name_msg[mlen++] = ' ';
-        name_msg[mlen++] = '*';
-        name_msg[mlen++] = '*';
-        name_msg[mlen++] = '*';
-        name_msg[mlen++] = '\n';
-        name_msg[mlen] = '\0';
+        int mlen = snprintf(name_msg, sizeof(name_msg), "*** %s is now known as %s ***\n",
+                            old_name, clients[slot].name);
         broadcast_message(name_msg, mlen, -1);  // Send to everyone including sender
         return;
     }
@@ -248,50 +189,25 @@ void handle_client_data(int slot) {
     if (n >= 5 && buf[0] == '/' && buf[1] == 'l' && buf[2] == 'i' && 
         buf[3] == 's' && buf[4] == 't') {
         char list_msg[512];
-        strcpy(list_msg, "Connected users:\n");
-        int llen = strlen(list_msg);
+        int llen = snprintf(list_msg, sizeof(list_msg), "Connected users:\n");
         
-        for (int i = 0; i < MAX_CLIENTS; i++) {
+        for (int i = 0; i < MAX_CLIENTS && llen < sizeof(list_msg); i++) {
             if (clients[i].active) {
-                list_msg[llen++] = ' ';
-                list_msg[llen++] = '-';
-                list_msg[llen++] = ' ';
-                for (int k = 0; clients[i].name[k]; k++) {
-                    list_msg[llen++] = clients[i].name[k];
-                }
-                if (i == slot) {
-                    char *you = " (you)";
-                    for (int k = 0; you[k]; k++) {
-                        list_msg[llen++] = you[k];
-                    }
-                }
-                list_msg[llen++] = '\n';
+                llen += snprintf(list_msg + llen, sizeof(list_msg) - llen, " - %s%s\n",
+                                 clients[i].name, i == slot ? " (you)" : "");
             }
         }
-        list_msg[llen] = '\0';
+        if (llen >= sizeof(list_msg))
+            llen = sizeof(list_msg) - 1;
         write(clients[slot].fd, list_msg, llen);
         return;
     }
     
     // Regular message - broadcast to all clients
     char broadcast[BUF_SIZE + 64];
-    broadcast[0] = '[';
-    int blen = 1;
-    for (int k = 0; clients[slot].name[k]; k++) {
-        broadcast[blen++] = clients[slot].name[k];
-    }
-    broadcast[blen++] = ']';
-    broadcast[blen++] = ' ';
-    
-    // Copy message, handling newline
-    for (int i = 0; i < n; i++) {
-        broadcast[blen++] = buf[i];
-    }
     // Ensure message ends with newline
-    if (n > 0 && buf[n-1] != '\n') {
-        broadcast[blen++] = '\n';
-    }
-    broadcast[blen] = '\0';
+    int blen = snprintf(broadcast, sizeof(broadcast), "[%s] %s%s", clients[slot].name, buf,
+                        buf[n-1] != '\n' ? "\n" : "");
     
     printf("chatserver: %s", broadcast);
     broadcast_message(broadcast, blen, slot);
@@ -414,16 +330,8 @@ int main(int argc, char *argv[]) {
                     if (fds[j].revents & (POLLERR | POLLHUP)) {
                         // Client disconnected
                         char leave_msg[128];
-                        strcpy(leave_msg, "*** ");
-                        int llen = 4;
-                        for (int k = 0; clients[i].name[k]; k++) {
-                            leave_msg[llen++] = clients[i].name[k];
-                        }
-                        char *left = " has left the chat ***\n";
-                        for (int k = 0; left[k]; k++) {
-                            leave_msg[llen++] = left[k];
-                        }
-                        leave_msg[llen] = '\0';
+                        int llen = snprintf(leave_msg, sizeof(leave_msg),
+                                            "*** %s has left the chat ***\n", clients[i].name);
                         remove_client(i);
                         broadcast_message(leave_msg, llen, -1);
                     }
@@ -0,0 +1,150 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Tests for clone() threads: shared memory, shared open
+// files, and per-thread exit and wait.
+
+#define NTHR 8
+#define STACKSIZE 4096
+
+static char stacks[NTHR][STACKSIZE];
+static volatile int slot[NTHR];
+static volatile char *heap;
+static volatile int fd = -1;
+static volatile int go;
+
+static void
+worker(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  // memory written here must show up in the parent.
+  for(int n = 0; n < 1000; n++)
+    slot[i]++;
+}
+
+static void
+opener(void *arg)
+{
+  // an fd opened by a thread is usable by its siblings.
+  fd = open("clonetest.tmp", O_CREATE | O_RDWR);
+}
+
+static void
+grower(void *arg)
+{
+  // sbrk() by the parent after clone() is visible here.
+  while(go == 0)
+    ;
+  heap[0] = 'x';
+  heap[4095] = 'y';
+}
+
+static void
+exiter(void *arg)
+{
+  exit(7);
+}
+
+static void
+waitall(int n)
+{
+  int status;
+
+  for(int i = 0; i < n; i++){
+    if(wait(&status) < 0){
+      printf("clonetest: wait failed\n");
+      exit(1);
+    }
+  }
+}
+
+static void
+memory(void)
+{
+  for(int i = 0; i < NTHR; i++){
+    if(thread_create(worker, (void*)(uint64)i, stacks[i], STACKSIZE) < 0){
+      printf("clonetest: thread_create failed\n");
+      exit(1);
+    }
+  }
+  waitall(NTHR);
+  for(int i = 0; i < NTHR; i++){
+    if(slot[i] != 1000){
+      printf("clonetest: slot %d is %d\n", i, slot[i]);
+      exit(1);
+    }
+  }
+}
+
+static void
+files(void)
+{
+  char buf[4];
+
+  thread_create(opener, 0, stacks[0], STACKSIZE);
+  waitall(1);
+  if(fd < 0){
+    printf("clonetest: thread's open failed\n");
+    exit(1);
+  }
+  if(write(fd, "abc", 3) != 3){
+    printf("clonetest: write to thread's fd failed\n");
+    exit(1);
+  }
+  close(fd);
+  fd = open("clonetest.tmp", O_RDONLY);
+  if(read(fd, buf, 3) != 3 || memcmp(buf, "abc", 3) != 0){
+    printf("clonetest: read back failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("clonetest.tmp");
+}
+
+static void
+grow(void)
+{
+  thread_create(grower, 0, stacks[0], STACKSIZE);
+  heap = sbrk(4096);
+  // memory may not shrink while it is shared.
+  if(sbrk(-4096) != (char*)-1){
+    printf("clonetest: shared memory shrank\n");
+    exit(1);
+  }
+  go = 1;
+  waitall(1);
+  if(heap[0] != 'x' || heap[4095] != 'y'){
+    printf("clonetest: thread did not see sbrk()\n");
+    exit(1);
+  }
+  if(sbrk(-4096) == (char*)-1){
+    printf("clonetest: sbrk(-4096) failed\n");
+    exit(1);
+  }
+}
+
+static void
+exits(void)
+{
+  int pid, status;
+
+  pid = thread_create(exiter, 0, stacks[0], STACKSIZE);
+  if(wait(&status) != pid || status != 7){
+    printf("clonetest: thread exit status %d\n", status);
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  memory();
+  files();
+  grow();
+  exits();
+  printf("clonetest: ok\n");
+  exit(0);
+}
@@ -0,0 +1,68 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+#include "user/coro.h"
+
+// Echo server written with coroutines: each connection is
+// handled by straight-line code in its own task, while the
+// runtime multiplexes them all over net_poll().
+// usage: coecho [port]
+
+static void
+handler(void *arg)
+{
+  int fd = (int)(uint64)arg;
+  char buf[512];
+  int n;
+
+  while((n = co_read(fd, buf, sizeof(buf))) > 0){
+    if(co_write(fd, buf, n) != n)
+      break;
+  }
+  close(fd);
+}
+
+static void
+acceptor(void *arg)
+{
+  int sock = (int)(uint64)arg;
+  struct sockaddr addr;
+  int len, fd;
+
+  for(;;){
+    if((fd = co_accept(sock, &addr, &len)) < 0){
+      co_sleep(1);
+      continue;
+    }
+    if(co_spawn(handler, (void*)(uint64)fd) < 0)
+      close(fd);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr addr = { .sa_family = AF_INET };
+  int sock;
+
+  addr.sin_port = argc > 1 ? atoi(argv[1]) : 80;
+  inetaddress("0.0.0.0", &addr);
+
+  if((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+    fprintf(2, "coecho: socket failed\n");
+    exit(1);
+  }
+  fcntl(sock, F_SETFL, O_NONBLOCK);
+  if(bind(sock, &addr, sizeof(addr)) < 0 || listen(sock, NSOCK) < 0){
+    fprintf(2, "coecho: bind/listen failed\n");
+    exit(1);
+  }
+  printf("coecho: listening on port %d\n", addr.sin_port);
+
+  co_spawn(acceptor, (void*)(uint64)sock);
+  co_run();
+  exit(0);
+}
@@ -0,0 +1,330 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+#include "user/coro.h"
+
+// Coroutine runtime; see coro.h.
+//
+// co_run() is the scheduler and runs on the caller's stack.
+// Every task switches back to it with thread_switch() when it
+// yields, parks or exits. When no task is ready, the scheduler
+// gathers the sockets that parked tasks wait on into one
+// net_poll() call, with a timeout for the earliest co_sleep().
+
+enum { CO_READY, CO_RUNNING, CO_WAITING, CO_SLEEPING, CO_DEAD };
+
+// Saved registers for thread_switch() in uthread_switch.S.
+struct context {
+  uint64 ra;
+  uint64 sp;
+  uint64 s[12];     // callee-saved s0-s11
+};
+
+struct coro {
+  struct context context;
+  char *stack;      // CO_STACKSIZE bytes, kept when the task exits
+  void (*fn)(void*);
+  void *arg;
+  int id;
+  int state;
+  int fd;           // CO_WAITING: socket and events waited for
+  int events;
+  int revents;      // what net_poll() reported
+  uint wake;        // CO_SLEEPING: uptime() to wake at
+  struct coro *next;
+};
+
+extern void thread_switch(uint64, uint64);
+
+static struct context sched;
+static struct coro *current;
+static struct coro *readyhead, *readytail;
+static struct coro *parked;    // CO_WAITING and CO_SLEEPING tasks
+static struct coro *pool;      // exited tasks, with stacks, for reuse
+static int nready, nlive, nextid;
+
+static void
+ready(struct coro *c)
+{
+  c->state = CO_READY;
+  c->next = 0;
+  if(readytail)
+    readytail->next = c;
+  else
+    readyhead = c;
+  readytail = c;
+  nready++;
+}
+
+static struct coro*
+popready(void)
+{
+  struct coro *c = readyhead;
+
+  if(c){
+    readyhead = c->next;
+    if(readyhead == 0)
+      readytail = 0;
+    nready--;
+  }
+  return c;
+}
+
+// Switch from the current task back to the scheduler.
+static void
+toscheduler(void)
+{
+  thread_switch((uint64)&current->context, (uint64)&sched);
+}
+
+// First code run by a new task, on its own stack.
+static void
+costart(void)
+{
+  current->fn(current->arg);
+  co_exit();
+}
+
+// Create a task that will run fn(arg). Returns its id, or -1.
+int
+co_spawn(void (*fn)(void*), void *arg)
+{
+  struct coro *c;
+
+  if((c = pool) != 0){
+    pool = c->next;
+  } else {
+    if((c = malloc(sizeof(*c))) == 0)
+      return -1;
+    if((c->stack = malloc(CO_STACKSIZE)) == 0){
+      free(c);
+      return -1;
+    }
+  }
+  memset(&c->context, 0, sizeof(c->context));
+  c->context.ra = (uint64)costart;
+  c->context.sp = ((uint64)c->stack + CO_STACKSIZE) & ~15L;
+  c->fn = fn;
+  c->arg = arg;
+  c->id = ++nextid;
+  nlive++;
+  ready(c);
+  return c->id;
+}
+
+int
+co_self(void)
+{
+  return current ? current->id : 0;
+}
+
+void
+co_yield(void)
+{
+  ready(current);
+  toscheduler();
+}
+
+void
+co_exit(void)
+{
+  current->state = CO_DEAD;
+  toscheduler();
+  exit(1);  // not reached
+}
+
+// Park until ticks clock ticks have passed.
+void
+co_sleep(int ticks)
+{
+  current->wake = uptime() + (ticks > 0 ? ticks : 0);
+  current->state = CO_SLEEPING;
+  current->next = parked;
+  parked = current;
+  toscheduler();
+}
+
+// Park until socket fd has one of events (POLLIN, POLLOUT).
+// Returns the events net_poll() reported, which may also be
+// POLLHUP, POLLERR or POLLNVAL.
+int
+co_wait(int fd, int events)
+{
+  current->fd = fd;
+  current->events = events;
+  current->revents = 0;
+  current->state = CO_WAITING;
+  current->next = parked;
+  parked = current;
+  toscheduler();
+  return current->revents;
+}
+
+// Read from a non-blocking socket, parking the task until
+// some data (or EOF) is available.
+int
+co_read(int fd, void *buf, int n)
+{
+  int r;
+
+  if((r = read(fd, buf, n)) >= 0)
+    return r;
+  if((co_wait(fd, POLLIN) & (POLLIN|POLLHUP)) == 0)
+    return -1;
+  return read(fd, buf, n);
+}
+
+// Write all n bytes to a non-blocking socket, parking the
+// task while lwIP's send buffer is full. Returns n, or -1
+// if nothing could be written.
+int
+co_write(int fd, const void *buf, int n)
+{
+  int r, m, done = 0, waited = 0;
+
+  while(done < n){
+    // the kernel takes at most SEND_BUFLEN bytes per write.
+    m = n - done < SEND_BUFLEN ? n - done : SEND_BUFLEN;
+    if((r = write(fd, (char*)buf + done, m)) > 0){
+      done += r;
+      waited = 0;
+      continue;
+    }
+    if(waited || (co_wait(fd, POLLOUT) & POLLOUT) == 0)
+      return done > 0 ? done : -1;
+    waited = 1;
+  }
+  return done;
+}
+
+// Accept a connection on a non-blocking listening socket,
+// parking the task until one arrives.
+int
+co_accept(int fd, struct sockaddr *addr, int *addrlen)
+{
+  int r;
+
+  if((r = accept(fd, addr, addrlen)) < 0){
+    if((co_wait(fd, POLLIN) & POLLIN) == 0)
+      return -1;
+    if((r = accept(fd, addr, addrlen)) < 0)
+      return -1;
+  }
+  fcntl(r, F_SETFL, O_NONBLOCK);
+  return r;
+}
+
+// Make parked tasks whose sockets or timers are ready runnable.
+// If block is set, wait until at least one is.
+static void
+poll(int block)
+{
+  struct pollfd fds[MAX_POLL_FDS];
+  struct coro *waiter[MAX_POLL_FDS];
+  struct coro *c, **pp;
+  int i, n, r, nwait, timeout, woke;
+  uint now, wake;
+
+  for(;;){
+    now = uptime();
+    woke = 0;
+    nwait = 0;
+    wake = 0;
+
+    // wake sleepers whose time has come; count the rest.
+    for(pp = &parked; (c = *pp) != 0; ){
+      if(c->state == CO_SLEEPING && (int)(c->wake - now) <= 0){
+        *pp = c->next;
+        ready(c);
+        woke++;
+        continue;
+      }
+      if(c->state == CO_SLEEPING && (wake == 0 || (int)(c->wake - wake) < 0))
+        wake = c->wake;
+      if(c->state == CO_WAITING)
+        nwait++;
+      pp = &c->next;
+    }
+    if(woke)
+      block = 0;
+
+    // net_poll() takes at most MAX_POLL_FDS sockets; with more
+    // waiters, poll them in batches without blocking.
+    timeout = -1;
+    if(!block || nwait > MAX_POLL_FDS)
+      timeout = 0;
+    else if(wake)
+      timeout = wake - now;
+
+    c = parked;
+    do {
+      n = 0;
+      for(; c && n < MAX_POLL_FDS; c = c->next){
+        if(c->state != CO_WAITING)
+          continue;
+        fds[n].fd = c->fd;
+        fds[n].events = c->events;
+        fds[n].revents = 0;
+        waiter[n++] = c;
+      }
+      if(n == 0){
+        if(timeout != 0 && wake)
+          sleep(timeout);
+        break;
+      }
+      if((r = net_poll(fds, n, timeout)) < 0){
+        // retrying a failed call would spin; let the tasks see
+        // the error instead, as co_wait()'s POLLERR.
+        for(i = 0; i < n; i++)
+          fds[i].revents = POLLERR;
+      } else if(r == 0)
+        continue;
+      for(i = 0; i < n; i++){
+        if(fds[i].revents == 0)
+          continue;
+        waiter[i]->revents = fds[i].revents;
+        for(pp = &parked; *pp != waiter[i]; pp = &(*pp)->next)
+          ;
+        *pp = waiter[i]->next;
+        ready(waiter[i]);
+        woke++;
+      }
+    } while(c);
+
+    if(woke || !block)
+      return;
+    // only reached with more than MAX_POLL_FDS waiters and
+    // none ready: back off for a tick rather than spin.
+    if(nwait > MAX_POLL_FDS)
+      sleep(1);
+  }
+}
+
+// Run tasks until all have exited.
+void
+co_run(void)
+{
+  struct coro *c;
+  int n;
+
+  while(nlive > 0){
+    // check sockets and timers once per round, so that busy
+    // tasks that keep yielding can't starve parked ones.
+    poll(nready == 0);
+
+    for(n = nready; n > 0 && (c = popready()) != 0; n--){
+      c->state = CO_RUNNING;
+      current = c;
+      thread_switch((uint64)&sched, (uint64)&c->context);
+      current = 0;
+      if(c->state == CO_DEAD){
+        c->next = pool;
+        pool = c;
+        nlive--;
+      }
+    }
+  }
+}
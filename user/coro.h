@@ -0,0 +1,23 @@
+// Coroutines: cooperative user-level tasks on pooled stacks,
+// scheduled around net_poll() so that a task blocked on a
+// socket costs nothing until the socket is ready.
+//
+// Spawn tasks with co_spawn(), then call co_run(), which
+// returns once every task has exited. Sockets used with
+// co_read(), co_write() and co_accept() must be O_NONBLOCK;
+// co_accept() makes the sockets it returns non-blocking.
+
+struct sockaddr;
+
+#define CO_STACKSIZE 4096   // bytes of stack per task
+
+int  co_spawn(void (*fn)(void*), void *arg);
+void co_run(void);
+int  co_self(void);
+void co_yield(void);
+void co_sleep(int ticks);
+void co_exit(void) __attribute__((noreturn));
+int  co_wait(int fd, int events);
+int  co_read(int fd, void *buf, int n);
+int  co_write(int fd, const void *buf, int n);
+int  co_accept(int fd, struct sockaddr *addr, int *addrlen);
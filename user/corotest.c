@@ -0,0 +1,97 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/coro.h"
+
+// Tests for the coroutine runtime in coro.c.
+
+#define NTASK 2000
+#define NYIELD 10
+
+static int count;
+static int order[3], norder;
+
+static void
+yielder(void *arg)
+{
+  for(int i = 0; i < NYIELD; i++){
+    count++;
+    co_yield();
+  }
+}
+
+static void
+sleeper(void *arg)
+{
+  int ticks = (int)(uint64)arg;
+
+  co_sleep(ticks);
+  order[norder++] = ticks;
+}
+
+static void
+spawner(void *arg)
+{
+  // tasks may spawn tasks.
+  for(int i = 0; i < 10; i++)
+    co_spawn(yielder, 0);
+}
+
+static void
+many(void)
+{
+  int i;
+
+  count = 0;
+  for(i = 0; i < NTASK; i++){
+    if(co_spawn(yielder, 0) < 0){
+      printf("corotest: co_spawn failed at %d\n", i);
+      exit(1);
+    }
+  }
+  co_run();
+  if(count != NTASK * NYIELD){
+    printf("corotest: count %d, expected %d\n", count, NTASK * NYIELD);
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *top;
+
+  printf("corotest: %d tasks\n", NTASK);
+  many();
+
+  // a second run must reuse the pooled stacks.
+  top = sbrk(0);
+  many();
+  if(sbrk(0) != top){
+    printf("corotest: stacks not reused\n");
+    exit(1);
+  }
+  printf("corotest: tasks ok\n");
+
+  co_spawn(sleeper, (void*)3);
+  co_spawn(sleeper, (void*)1);
+  co_spawn(sleeper, (void*)2);
+  co_run();
+  if(norder != 3 || order[0] != 1 || order[1] != 2 || order[2] != 3){
+    printf("corotest: sleepers woke out of order\n");
+    exit(1);
+  }
+  printf("corotest: sleep ok\n");
+
+  count = 0;
+  co_spawn(spawner, 0);
+  co_run();
+  if(count != 10 * NYIELD){
+    printf("corotest: nested spawn count %d\n", count);
+    exit(1);
+  }
+  printf("corotest: spawn ok\n");
+
+  printf("corotest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,131 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+
+// Tests for the resolver, run against dnsserver.py on the
+// QEMU host: blocking and concurrent lookups, the answer
+// cache, and the negative cache.
+//
+//   dnstest [server address]
+
+#define NLOOKUP 4
+
+static void
+fail(char *msg)
+{
+  printf("dnstest: %s\n", msg);
+  exit(1);
+}
+
+static uint32
+ip(char *s)
+{
+  struct sockaddr a;
+
+  inetaddress(s, &a);
+  return a.sin_addr;
+}
+
+// the address a resolve() descriptor reads as, or 0.
+static uint32
+result(int fd)
+{
+  uint32 a = 0;
+  int n = read(fd, &a, sizeof(a));
+
+  close(fd);
+  if(n < 0)
+    fail("read of a lookup failed");
+  return n == sizeof(a) ? a : 0;
+}
+
+static void
+blocking(void)
+{
+  struct sockaddr a;
+
+  if(gethostbyname("xv6.test", &a) < 0 || a.sin_addr != ip("10.9.8.7"))
+    fail("gethostbyname(xv6.test)");
+  if(gethostbyname("nosuch.test", &a) != -1)
+    fail("gethostbyname of a missing name succeeded");
+}
+
+static void
+concurrent(void)
+{
+  struct pollfd pfd[NLOOKUP];
+  char name[16], want[16];
+  int i, left;
+
+  // all queries are in flight before any answer is read.
+  for(i = 0; i < NLOOKUP; i++){
+    strcpy(name, "hostN.test");
+    name[4] = '1' + i;
+    if((pfd[i].fd = resolve(name)) < 0)
+      fail("resolve failed");
+    pfd[i].events = POLLIN;
+  }
+  for(left = NLOOKUP; left > 0; ){
+    if(net_poll(pfd, NLOOKUP, 50) <= 0)
+      fail("net_poll timed out on lookups");
+    for(i = 0; i < NLOOKUP; i++){
+      if(pfd[i].fd < 0 || !(pfd[i].revents & POLLIN))
+        continue;
+      strcpy(want, "10.9.8.N");
+      want[7] = '1' + i;
+      if(result(pfd[i].fd) != ip(want))
+        fail("concurrent lookup got the wrong address");
+      pfd[i].fd = -1;
+      left--;
+    }
+  }
+}
+
+static void
+cached(void)
+{
+  uint32 a;
+  int fd;
+
+  // xv6.test was looked up above: no round trip this time.
+  if((fd = resolve("xv6.test")) < 0)
+    fail("resolve failed");
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  if(read(fd, &a, sizeof(a)) != sizeof(a) || a != ip("10.9.8.7"))
+    fail("cached lookup was not ready at once");
+  close(fd);
+}
+
+static void
+negative(void)
+{
+  int fd;
+
+  for(int i = 0; i < 3; i++){
+    if((fd = resolve("nx.test")) < 0)
+      fail("resolve failed");
+    if(result(fd) != 0)
+      fail("nx.test resolved");
+  }
+  // the server counts the queries it saw for nx.test.
+  if((fd = resolve("count1.test")) < 0)
+    fail("resolve failed");
+  if(result(fd) != ip("10.0.0.1"))
+    fail("failed lookups were not cached");
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(dnsserver(ip(argc > 1 ? argv[1] : "10.0.2.2")) < 0)
+    fail("dnsserver failed");
+  blocking();
+  concurrent();
+  cached();
+  negative();
+  printf("dnstest: ok\n");
+  exit(0);
+}
@@ -0,0 +1,187 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Tests for exec()'s shared, demand-paged program images.
+// exectest runs copies of itself; argv[1] says what a copy does.
+
+#define NSPAWN 50
+#define NWAIT 4
+#define PGSIZE 4096
+
+int data = 42;             // initialized, so in the file
+char bss[16*PGSIZE];       // zero-filled on first touch
+char buf[512];
+
+static void
+fail(char *msg)
+{
+  printf("exectest: %s\n", msg);
+  exit(1);
+}
+
+// run prog with argument arg; return its exit status.
+static int
+spawn(char *prog, char *arg, int quiet)
+{
+  char *argv[] = {prog, arg, 0};
+  int pid, status;
+
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    if(quiet)
+      close(1);
+    exec(prog, argv);
+    exit(99);
+  }
+  wait(&status);
+  return status;
+}
+
+static void
+copy(char *from, char *to)
+{
+  int fd0, fd1, n;
+
+  if((fd0 = open(from, O_RDONLY)) < 0 ||
+     (fd1 = open(to, O_CREATE | O_TRUNC | O_WRONLY)) < 0)
+    fail("open failed");
+  while((n = read(fd0, buf, sizeof(buf))) > 0)
+    if(write(fd1, buf, n) != n)
+      fail("write failed");
+  close(fd0);
+  close(fd1);
+}
+
+// writes go to private copies, never to the shared image.
+static void
+privatewrites(void)
+{
+  int status;
+
+  if(spawn("exectest", "scribble", 0) != 0)
+    fail("scribble failed");
+  if(spawn("exectest", "status", 0) != 42)
+    fail("a copy's write changed the image");
+
+  if(data != 42)
+    fail("data not initialized");
+  if(fork() == 0){
+    data = 7;
+    exit(data == 7 ? 0 : 1);
+  }
+  wait(&status);
+  if(status != 0 || data != 42)
+    fail("fork child's write reached the parent");
+
+  for(int i = 0; i < sizeof(bss); i += PGSIZE)
+    if(bss[i] != 0)
+      fail("bss not zeroed");
+  bss[sizeof(bss) - 1] = 1;
+
+  // the kernel copies into image pages the same way.
+  if(spawn("exectest", "readdata", 0) != 0)
+    fail("read() into the image failed");
+  if(spawn("exectest", "status", 0) != 42)
+    fail("a copy's read() changed the image");
+}
+
+// a program rewritten after it ran is read again.
+static void
+rewrite(void)
+{
+  copy("exectest", "exectmp");
+  if(spawn("exectmp", "status", 0) != 42)
+    fail("exec of a copy failed");
+  copy("echo", "exectmp");
+  if(spawn("exectmp", "status", 1) != 0)
+    fail("exec ran a stale image");
+  unlink("exectmp");
+}
+
+// copies left waiting share their pages.
+static void
+sharing(void)
+{
+  int in[2], ready[2], n0, per, image;
+  char c;
+
+  image = (uint64)sbrk(0) / PGSIZE - 2;  // less the stack
+  if(pipe(in) < 0 || pipe(ready) < 0)
+    fail("pipe failed");
+  n0 = nfree();
+  for(int i = 0; i < NWAIT; i++){
+    if(fork() == 0){
+      char *argv[] = {"exectest", "wait", 0};
+      close(0);
+      dup(in[0]);
+      close(1);
+      dup(ready[1]);
+      close(in[0]);
+      close(in[1]);
+      close(ready[0]);
+      close(ready[1]);
+      exec("exectest", argv);
+      exit(1);
+    }
+  }
+  close(ready[1]);
+  for(int i = 0; i < NWAIT; i++)
+    if(read(ready[0], &c, 1) != 1)
+      fail("waiting copy did not start");
+  per = (n0 - nfree()) / NWAIT;
+  close(in[0]);
+  close(in[1]);
+  close(ready[0]);
+  for(int i = 0; i < NWAIT; i++)
+    wait(0);
+
+  printf("exectest: %d pages per waiting copy of a %d-page image\n",
+         per, image);
+  if(per >= image)
+    fail("copies do not share their image");
+}
+
+static void
+spawning(void)
+{
+  int t0 = uptime();
+
+  for(int i = 0; i < NSPAWN; i++)
+    if(spawn("exectest", "nop", 0) != 0)
+      fail("spawn failed");
+  printf("exectest: %d spawns in %d ticks\n", NSPAWN, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1){
+    if(strcmp(argv[1], "scribble") == 0){
+      data = 0;
+      bss[0] = 1;
+      exit(0);
+    } else if(strcmp(argv[1], "status") == 0){
+      exit(data);
+    } else if(strcmp(argv[1], "readdata") == 0){
+      // data's page is unmapped, or shared with the image.
+      int fd = open("exectest", O_RDONLY);
+      exit(read(fd, (char*)&data, sizeof(data)) == sizeof(data) ? 0 : 1);
+    } else if(strcmp(argv[1], "wait") == 0){
+      char c;
+      write(1, "r", 1);
+      read(0, &c, 1);
+      exit(0);
+    }
+    exit(0);
+  }
+
+  privatewrites();
+  rewrite();
+  sharing();
+  spawning();
+  printf("exectest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,172 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/sync.h"
+
+// Tests for futex_wait()/futex_wake() and the sync.c helpers,
+// run across clone() threads.
+
+#define NTHR 4
+#define STACKSIZE 4096
+#define NINC 10000
+#define NITEM 1000
+
+static char stacks[NTHR][STACKSIZE];
+
+static void
+fail(char *msg)
+{
+  printf("futextest: %s\n", msg);
+  exit(1);
+}
+
+static void
+spawn(void (*fn)(void*), int i)
+{
+  if(thread_create(fn, (void*)(uint64)i, stacks[i], STACKSIZE) < 0)
+    fail("thread_create failed");
+}
+
+static void
+join(int n)
+{
+  while(n-- > 0)
+    if(wait(0) < 0)
+      fail("wait failed");
+}
+
+static void
+basic(void)
+{
+  volatile int word = 0;
+
+  if(futex_wait(&word, 1, 0) != 0)
+    fail("futex_wait with a stale value should return 0");
+  if(futex_wait(&word, 0, 2) != 1)
+    fail("futex_wait should time out");
+  if(futex_wake(&word, 1) != 0)
+    fail("futex_wake woke someone");
+  if(futex_wait((int*)1, 0, 0) != -1)
+    fail("futex_wait on a misaligned address");
+}
+
+static struct mutex m;
+static int counter;
+
+static void
+incr(void *arg)
+{
+  for(int i = 0; i < NINC; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+}
+
+static void
+mutexes(void)
+{
+  for(int i = 0; i < NTHR; i++)
+    spawn(incr, i);
+  join(NTHR);
+  if(counter != NTHR * NINC)
+    fail("lost increments under mutex");
+  if(!mutex_trylock(&m) || mutex_trylock(&m))
+    fail("mutex_trylock");
+  mutex_unlock(&m);
+}
+
+// a one-slot buffer handed back and forth with a condition variable.
+static struct cond c;
+static int slot, full;
+
+static void
+producer(void *arg)
+{
+  for(int i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(full)
+      cond_wait(&c, &m);
+    slot = i;
+    full = 1;
+    cond_broadcast(&c);
+    mutex_unlock(&m);
+  }
+}
+
+static void
+conds(void)
+{
+  spawn(producer, 0);
+  for(int i = 1; i <= NITEM; i++){
+    mutex_lock(&m);
+    while(!full)
+      cond_wait(&c, &m);
+    if(slot != i)
+      fail("condition variable handoff out of order");
+    full = 0;
+    cond_broadcast(&c);
+    mutex_unlock(&m);
+  }
+  join(1);
+
+  mutex_lock(&m);
+  if(cond_timedwait(&c, &m, 2) != 1)
+    fail("cond_timedwait should time out");
+  mutex_unlock(&m);
+}
+
+struct item {
+  struct mpscnode node;   // first, so a node is its item
+  int from;
+  int seq;
+};
+
+static struct mpsc q;
+static struct item items[NTHR][NITEM];
+
+static void
+pusher(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  for(int j = 0; j < NITEM; j++){
+    items[i][j].from = i;
+    items[i][j].seq = j;
+    mpsc_push(&q, &items[i][j].node);
+  }
+}
+
+static void
+queues(void)
+{
+  int next[NTHR];
+  struct item *it;
+
+  if(mpsc_pop(&q, -1) != 0)
+    fail("mpsc_pop on an empty queue");
+  for(int i = 0; i < NTHR; i++){
+    next[i] = 0;
+    spawn(pusher, i);
+  }
+  for(int n = 0; n < NTHR * NITEM; n++){
+    if((it = (struct item*)mpsc_pop(&q, 0)) == 0)
+      fail("mpsc_pop returned nothing");
+    if(it->seq != next[it->from]++)
+      fail("mpsc items out of order");
+  }
+  join(NTHR);
+  if(mpsc_pop(&q, 2) != 0)
+    fail("mpsc_pop should time out");
+}
+
+int
+main(int argc, char *argv[])
+{
+  basic();
+  mutexes();
+  conds();
+  queues();
+  printf("futextest: ok\n");
+  exit(0);
+}
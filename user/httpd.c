@@ -1,6 +1,7 @@
 #include "kernel/param.h"
 #include "kernel/types.h"
 #include "kernel/spinlock.h"
+#include "kernel/socklat.h"
 #include "kernel/socket.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
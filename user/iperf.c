@@ -0,0 +1,68 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "kernel/iperf.h"
+#include "user/user.h"
+
+// Measure TCP throughput of the driver and lwIP alone, with
+// the iperf2 endpoint in the kernel; the kernel prints each
+// result on the console.
+// usage: iperf -s [-p port]
+//        iperf -c host [-p port]
+//   -s  serve iperf2 clients, one test after another, until
+//       killed; e.g. "iperf -c localhost -p 5001" on the host
+//       through QEMU's forwarded port.
+//   -c  send to an iperf2 server ("iperf -s" on the host is
+//       at 10.0.2.2) for 10 seconds.
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: iperf -s [-p port] | -c host [-p port]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iperfreport r;
+  struct sockaddr a;
+  int i, mode = -1, port = IPERF_PORT;
+  char *host = 0;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-s") == 0){
+      mode = IPERF_SERVER;
+    } else if(strcmp(argv[i], "-c") == 0 && i+1 < argc){
+      mode = IPERF_CLIENT;
+      host = argv[++i];
+    } else if(strcmp(argv[i], "-p") == 0 && i+1 < argc){
+      port = atoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if(mode < 0)
+    usage();
+
+  if(mode == IPERF_CLIENT){
+    if(gethostbyname(host, &a) < 0){
+      fprintf(2, "iperf: cannot resolve %s\n", host);
+      exit(1);
+    }
+    if(iperf(IPERF_CLIENT, a.sin_addr, port, &r) < 0){
+      fprintf(2, "iperf: cannot start a test to %s\n", host);
+      exit(1);
+    }
+    exit(r.aborted);
+  }
+
+  for(;;){
+    if(iperf(IPERF_SERVER, 0, port, &r) < 0){
+      fprintf(2, "iperf: cannot listen on port %d\n", port);
+      exit(1);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// Print kernel spinlock statistics, most contended first.
+// usage: lockstat [-r] [command [args...]]
+//   -r       zero the counters after printing
+//   command  zero the counters, run command, then print
+//            the statistics for just that run
+
+#define NSTAT 64
+
+static struct lockstat ls[NSTAT];
+
+// hundredths of a microsecond, printed as "us.xx"
+static void
+printus(uint64 ticks)
+{
+  // mtime runs at 10 MHz under qemu.
+  uint64 us100 = ticks * 10;
+
+  printf("%l.%s%l", us100 / 100, us100 % 100 < 10 ? "0" : "", us100 % 100);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, reset = 0, pid;
+  struct lockstat t;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    reset = 1;
+    argc--;
+    argv++;
+  }
+
+  if(argc > 1){
+    lockstat(ls, 0, 1);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((n = lockstat(ls, NSTAT, reset)) < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+
+  // rank by spins, then by acquisitions.
+  for(i = 1; i < n; i++){
+    t = ls[i];
+    for(j = i; j > 0; j--){
+      if(ls[j-1].nspin > t.nspin ||
+         (ls[j-1].nspin == t.nspin && ls[j-1].nacquire >= t.nacquire))
+        break;
+      ls[j] = ls[j-1];
+    }
+    ls[j] = t;
+  }
+
+  printf("%s\t\t%s\t%s\t%s\t%s\t%s\n",
+         "lock", "#locks", "acquire", "spin", "hold(us)", "maxhold(us)");
+  for(i = 0; i < n; i++){
+    if(ls[i].nacquire == 0)
+      continue;
+    printf("%s\t%s%d\t%l\t%l\t", ls[i].name, strlen(ls[i].name) < 8 ? "\t" : "",
+           ls[i].nlocks, ls[i].nacquire, ls[i].nspin);
+    printus(ls[i].holdtime);
+    printf("\t");
+    printus(ls[i].maxhold);
+    printf("\n");
+  }
+  exit(0);
+}
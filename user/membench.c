@@ -0,0 +1,91 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// Micro-benchmark for the ulib memmove/memset/memcmp kernels.
+// Reports bytes per cycle (rdcycle) for a few sizes that show
+// up on the network path, with aligned and misaligned sources.
+// usage: membench [total-bytes-per-test]
+
+#define MAXSZ (64*1024)
+
+static char src[MAXSZ + 64];
+static char dst[MAXSZ + 64];
+
+static int sizes[] = { 64, 512, 1514, 4096, MAXSZ };
+static int offs[] = { 0, 3 };
+
+// the old byte-at-a-time ulib memmove, as a baseline.
+static void
+bytecopy(char *d, const char *s, int n)
+{
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+static void
+report(char *name, int size, int off, uint64 bytes, uint64 cycles)
+{
+  uint64 r;
+
+  if(cycles == 0)
+    cycles = 1;
+  r = bytes * 100 / cycles;
+  printf("%s\t%d\t+%d\t%l.%s%l bytes/cycle\n", name, size, off,
+         r / 100, r % 100 < 10 ? "0" : "", r % 100);
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 total = 4*1024*1024;
+  uint64 t0, t1;
+  int i, j, k, n, iters;
+  volatile int sink = 0;
+
+  if(argc > 1)
+    total = atoi(argv[1]);
+
+  memset(src, 'x', sizeof(src));
+  printf("test\tsize\tsrc\tthroughput\n");
+
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    n = sizes[i];
+    iters = total / n;
+    if(iters == 0)
+      iters = 1;
+    for(j = 0; j < sizeof(offs)/sizeof(offs[0]); j++){
+      char *s = src + offs[j];
+
+      t0 = r_cycle();
+      for(k = 0; k < iters; k++)
+        bytecopy(dst, s, n);
+      t1 = r_cycle();
+      report("bytes", n, offs[j], (uint64)iters * n, t1 - t0);
+
+      t0 = r_cycle();
+      for(k = 0; k < iters; k++)
+        memmove(dst, s, n);
+      t1 = r_cycle();
+      report("memmove", n, offs[j], (uint64)iters * n, t1 - t0);
+
+      t0 = r_cycle();
+      for(k = 0; k < iters; k++)
+        memset(dst + offs[j], k, n);
+      t1 = r_cycle();
+      report("memset", n, offs[j], (uint64)iters * n, t1 - t0);
+
+      memmove(dst, s, n);
+      t0 = r_cycle();
+      for(k = 0; k < iters; k++)
+        sink += memcmp(dst, s, n);
+      t1 = r_cycle();
+      report("memcmp", n, offs[j], (uint64)iters * n, t1 - t0);
+    }
+  }
+
+  if(sink != 0)
+    printf("membench: memcmp mismatch\n");
+  exit(0);
+}
@@ -0,0 +1,144 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/netstat.h"
+#include "user/user.h"
+
+// Print network statistics: lwIP's per-protocol counters and
+// memory pools, the virtio-net driver's counters and the
+// open sockets.
+// usage: netstat [-w ticks]
+//   -w  after the full report, print one line of counter
+//       changes every ticks clock ticks, until killed.
+
+static char *protos[NS_NPROTO] = {
+[NS_LINK]   "link",
+[NS_ETHARP] "etharp",
+[NS_IP]     "ip",
+[NS_ICMP]   "icmp",
+[NS_UDP]    "udp",
+[NS_TCP]    "tcp",
+};
+
+static char *sockstates[] = {
+  "free", "unconn", "connecting", "listen", "accepting",
+  "connected", "sending", "recving",
+};
+
+static char *tcpstates[] = {
+  "CLOSED", "LISTEN", "SYN_SENT", "SYN_RCVD", "ESTABLISHED",
+  "FIN_WAIT_1", "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK",
+  "TIME_WAIT",
+};
+
+static struct netstat ns, old;
+
+static void
+printaddr(uint32 a, int port)
+{
+  uchar *b = (uchar*)&a;
+
+  printf("%d.%d.%d.%d:%d", b[0], b[1], b[2], b[3], port);
+}
+
+static void
+report(void)
+{
+  struct netstat_proto *p;
+  struct netstat_sock *s;
+  int i;
+
+  printf("proto\txmit\trecv\tdrop\tchkerr\tlenerr\tmemerr\trterr\tproterr\terr\n");
+  for(i = 0; i < NS_NPROTO; i++){
+    p = &ns.proto[i];
+    printf("%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", protos[i],
+           p->xmit, p->recv, p->drop, p->chkerr, p->lenerr,
+           p->memerr, p->rterr, p->proterr, p->err);
+  }
+
+  printf("\npool\t\tavail\tused\tmax\terr\n");
+  for(i = 0; i < ns.npool; i++)
+    printf("%s\t%s%d\t%d\t%d\t%d\n", ns.pool[i].name,
+           strlen(ns.pool[i].name) < 8 ? "\t" : "",
+           ns.pool[i].avail, ns.pool[i].used, ns.pool[i].max, ns.pool[i].err);
+
+  printf("\nvirtio-net: rx %l frames %l bytes, tx %l frames %l bytes\n",
+         ns.rx_frames, ns.rx_bytes, ns.tx_frames, ns.tx_bytes);
+  printf("drops: tx ring full %l, rx no pbuf %l, rx refused %l, "
+         "sock_recv held back %l\n",
+         ns.tx_ring_full, ns.rx_nobuf, ns.rx_drop, ns.recv_errmem);
+  printf("gro: %l segments merged\n", ns.rx_gro);
+  printf("rx: %l frames over several buffers\n", ns.rx_chain);
+
+  printf("\npid\tfd\tstate\t\ttcp\t\trecvq\tsndbuf\tsndq\tunacked\tin\tout\tacked\n");
+  for(i = 0; i < ns.nsock; i++){
+    s = &ns.sock[i];
+    printf("%d\t%d\t%s\t%s", s->pid, s->fd, sockstates[s->state],
+           strlen(sockstates[s->state]) < 8 ? "\t" : "");
+    if(s->tcpstate < 0)
+      printf("-\t\t");
+    else
+      printf("%s\t%s", tcpstates[s->tcpstate],
+             strlen(tcpstates[s->tcpstate]) < 8 ? "\t" : "");
+    printf("%d\t%d\t%d\t%d\t%l\t%l\t%l\n", s->recvq, s->sndbuf,
+           s->sndqueue, s->unacked, s->bytes_in, s->bytes_out, s->sent_len);
+    if(s->tcpstate >= 0){
+      printf("\t");
+      printaddr(s->laddr, s->lport);
+      printf(" -> ");
+      printaddr(s->raddr, s->rport);
+      printf("\n");
+    }
+  }
+}
+
+// one line of counter changes since old.
+static void
+delta(void)
+{
+  struct netstat_proto *t = &ns.proto[NS_TCP], *ot = &old.proto[NS_TCP];
+  uint32 poolerr = 0;
+  int i;
+
+  for(i = 0; i < ns.npool; i++)
+    poolerr += ns.pool[i].err - old.pool[i].err;
+  printf("rx %l/%l tx %l/%l frames/bytes  tcp in %d out %d drop %d  "
+         "ringfull %l nopbuf %l refused %l heldback %l gro %l poolerr %d\n",
+         ns.rx_frames - old.rx_frames, ns.rx_bytes - old.rx_bytes,
+         ns.tx_frames - old.tx_frames, ns.tx_bytes - old.tx_bytes,
+         t->recv - ot->recv, t->xmit - ot->xmit, t->drop - ot->drop,
+         ns.tx_ring_full - old.tx_ring_full, ns.rx_nobuf - old.rx_nobuf,
+         ns.rx_drop - old.rx_drop, ns.recv_errmem - old.recv_errmem,
+         ns.rx_gro - old.rx_gro, poolerr);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 0;
+
+  if(argc == 3 && strcmp(argv[1], "-w") == 0)
+    interval = atoi(argv[2]);
+  if(argc != 1 && interval <= 0){
+    fprintf(2, "usage: netstat [-w ticks]\n");
+    exit(1);
+  }
+
+  if(netstat(&ns) < 0){
+    fprintf(2, "netstat: failed\n");
+    exit(1);
+  }
+  report();
+
+  while(interval > 0){
+    fflush(1);
+    old = ns;
+    sleep(interval);
+    if(netstat(&ns) < 0){
+      fprintf(2, "netstat: failed\n");
+      exit(1);
+    }
+    delta();
+  }
+  exit(0);
+}
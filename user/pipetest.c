@@ -0,0 +1,160 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+
+// Tests for page-backed pipes: the default size, resizing with
+// fcntl(), throughput, and splice() from a pipe to a socket
+// over the loopback interface.
+
+#define PORT 5001
+#define NSPLICE (256*1024)
+#define NBENCH (4*1024*1024)
+
+static char buf[64*1024];
+
+static void
+fail(char *msg)
+{
+  printf("pipetest: %s\n", msg);
+  exit(1);
+}
+
+static void
+sizes(void)
+{
+  int fds[2], i;
+
+  if(pipe(fds) < 0)
+    fail("pipe failed");
+  if(fcntl(fds[1], F_GETPIPE_SZ, 0) != 65536)
+    fail("default pipe size is not 64 KiB");
+
+  // a whole 64 KiB fits without a reader.
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i % 251;
+  if(write(fds[1], buf, sizeof(buf)) != sizeof(buf))
+    fail("write of 64 KiB failed");
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1)
+    fail("shrank a pipe below its contents");
+
+  // move the read point so the data wraps, then grow.
+  if(read(fds[0], buf, 1000) != 1000)
+    fail("read failed");
+  if(write(fds[1], buf, 1000) != 1000)
+    fail("write failed");
+  if(fcntl(fds[1], F_SETPIPE_SZ, 100000) != 131072)
+    fail("F_SETPIPE_SZ did not round up to 128 KiB");
+  for(i = 1000; i < sizeof(buf); i += 4096){
+    int n = sizeof(buf) - i < 4096 ? sizeof(buf) - i : 4096;
+    char got[4096];
+    if(read(fds[0], got, n) != n)
+      fail("read after resize failed");
+    for(int j = 0; j < n; j++)
+      if(got[j] != (i + j) % 251)
+        fail("data changed across resize");
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void
+bench(void)
+{
+  int fds[2], n, start;
+
+  if(pipe(fds) < 0)
+    fail("pipe failed");
+  start = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(n = 0; n < NBENCH; n += sizeof(buf))
+      if(write(fds[1], buf, sizeof(buf)) != sizeof(buf))
+        fail("bench write failed");
+    exit(0);
+  }
+  close(fds[1]);
+  for(n = 0; n < NBENCH; ){
+    int r = read(fds[0], buf, sizeof(buf));
+    if(r <= 0)
+      fail("bench read failed");
+    n += r;
+  }
+  close(fds[0]);
+  wait(0);
+  printf("pipetest: %d KiB through a pipe in %d ticks\n",
+         NBENCH / 1024, uptime() - start);
+}
+
+static void
+splices(void)
+{
+  struct sockaddr addr, peer;
+  int fds[2], srv, conn, n, r, peerlen;
+
+  if(splice(0, 1, 1) != -1)
+    fail("splice between non-pipes");
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sa_family = AF_INET;
+  addr.sin_port = PORT;  // bind() takes the port in host order
+  inetaddress("127.0.0.1", &addr);
+  if((srv = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+     bind(srv, &addr, sizeof(addr)) < 0 || listen(srv, 1) < 0)
+    fail("listen failed");
+  addr.sin_port = htons(PORT);
+
+  if(fork() == 0){
+    // the child fills a pipe and splices it into a connection.
+    close(srv);
+    if((conn = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+       connect(conn, &addr, sizeof(addr)) < 0)
+      fail("connect failed");
+    if(pipe(fds) < 0)
+      fail("pipe failed");
+    if(fork() == 0){
+      close(fds[0]);
+      for(n = 0; n < NSPLICE; n += 512){
+        for(int i = 0; i < 512; i++)
+          buf[i] = (n + i) % 251;
+        if(write(fds[1], buf, 512) != 512)
+          fail("write to splice pipe failed");
+      }
+      exit(0);
+    }
+    close(fds[1]);
+    for(n = 0; n < NSPLICE; n += r)
+      if((r = splice(fds[0], conn, NSPLICE - n)) <= 0)
+        fail("splice failed");
+    if(splice(fds[0], conn, 1) != 0)
+      fail("splice at end of pipe");
+    wait(0);
+    close(conn);
+    exit(0);
+  }
+
+  if((conn = accept(srv, &peer, &peerlen)) < 0)
+    fail("accept failed");
+  for(n = 0; n < NSPLICE; n += r){
+    if((r = read(conn, buf, 512)) <= 0)
+      fail("read from spliced socket failed");
+    for(int i = 0; i < r; i++)
+      if(buf[i] != (n + i) % 251)
+        fail("spliced data corrupted");
+  }
+  wait(0);
+  close(conn);
+  close(srv);
+}
+
+int
+main(int argc, char *argv[])
+{
+  sizes();
+  bench();
+  splices();
+  printf("pipetest: ok\n");
+  exit(0);
+}
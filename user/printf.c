@@ -6,26 +6,96 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// A buffered output stream on top of a file descriptor.
+// stdout is line buffered when it is the console and fully
+// buffered otherwise (files, pipes, sockets); stderr is
+// unbuffered, i.e. flushed at the end of every call.
+struct stream {
+  int fd;
+  int mode;          // _IONBF, _IOLBF, _IOFBF, or 0 if not yet decided
+  int n;             // bytes waiting in buf
+  char buf[BUFSIZ];
+};
+
+static struct stream out = { 1, 0 };
+static struct stream err = { 2, _IONBF };
+
+// scratch stream for fprintf() to any other fd, flushed
+// before the call returns so it never holds data across calls.
+static struct stream tmp = { -1, _IONBF };
+
+// Where formatted output goes: either a stream or a string.
+struct sink {
+  struct stream *s;
+  char *str;         // snprintf() destination
+  int size;          // capacity of str, including the nul
+  int n;             // number of characters produced so far
+};
+
+static void
+sflush(struct stream *s)
+{
+  char *p = s->buf;
+
+  while(s->n > 0){
+    int r = write(s->fd, p, s->n);
+    if(r <= 0)
+      break;
+    p += r;
+    s->n -= r;
+  }
+  s->n = 0;
+}
+
 static void
-putc(int fd, char c)
+flushall(void)
+{
+  sflush(&out);
+  sflush(&err);
+}
+
+static struct stream*
+getstream(int fd)
 {
-  write(fd, &c, 1);
+  struct stat st;
+
+  if(fd == 1){
+    if(out.mode == 0){
+      // decide lazily, since fd 1 may be redirected by sh.
+      if(fstat(1, &st) == 0 && st.type == T_DEVICE)
+        out.mode = _IOLBF;
+      else
+        out.mode = _IOFBF;
+    }
+    return &out;
+  }
+  if(fd == 2)
+    return &err;
+
+  tmp.fd = fd;
+  return &tmp;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+putc(struct sink *o, char c)
 {
-  char buf[16];
-  int i, neg;
-  uint x;
-
-  neg = 0;
-  if(sgn && xx < 0){
-    neg = 1;
-    x = -xx;
-  } else {
-    x = xx;
+  struct stream *s = o->s;
+
+  if(s){
+    if(s->n == BUFSIZ)
+      sflush(s);
+    s->buf[s->n++] = c;
+  } else if(o->n < o->size - 1){
+    o->str[o->n] = c;
   }
+  o->n++;
+}
+
+static void
+printint(struct sink *o, uint64 x, int base, int neg)
+{
+  char buf[24];
+  int i;
 
   i = 0;
   do{
@@ -35,24 +105,24 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct sink *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-vprintf(int fd, const char *fmt, va_list ap)
+// Format into o. Only understands %d, %u, %l, %x, %p, %s, %c.
+static void
+format(struct sink *o, const char *fmt, va_list ap)
 {
   char *s;
-  int c, i, state;
+  int c, i, d, state;
 
   state = 0;
   for(i = 0; fmt[i]; i++){
@@ -61,39 +131,75 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(o, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        d = va_arg(ap, int);
+        if(d < 0)
+          printint(o, -(uint64)d, 10, 1);
+        else
+          printint(o, d, 10, 0);
+      } else if(c == 'u') {
+        printint(o, va_arg(ap, uint), 10, 0);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(o, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(o, va_arg(ap, uint), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(o, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(o, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(o, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(o, '%');
+        putc(o, c);
       }
       state = 0;
     }
   }
 }
 
+// Print to the given fd through its stream, then flush
+// as the stream's buffering mode requires.
+void
+vprintf(int fd, const char *fmt, va_list ap)
+{
+  struct sink o = { 0 };
+  struct stream *s;
+  int start;
+
+  s = o.s = getstream(fd);
+  start = s->n;
+  format(&o, fmt, ap);
+
+  if(s->mode == _IONBF){
+    sflush(s);
+  } else if(s->mode == _IOLBF){
+    // one write for the whole call if it completed a line.
+    for(int i = start < s->n ? start : 0; i < s->n; i++){
+      if(s->buf[i] == '\n'){
+        sflush(s);
+        break;
+      }
+    }
+  }
+
+  // make sure exit() and fork() see the buffered data.
+  if(out.n > 0)
+    stdio_flush = flushall;
+}
+
 void
 fprintf(int fd, const char *fmt, ...)
 {
@@ -101,6 +207,7 @@ fprintf(int fd, const char *fmt, ...)
 
   va_start(ap, fmt);
   vprintf(fd, fmt, ap);
+  va_end(ap);
 }
 
 void
@@ -110,4 +217,29 @@ printf(const char *fmt, ...)
 
   va_start(ap, fmt);
   vprintf(1, fmt, ap);
+  va_end(ap);
+}
+
+// Write any output buffered for fd.
+void
+fflush(int fd)
+{
+  sflush(getstream(fd));
+}
+
+// Format into buf, writing at most size bytes including the
+// terminating nul. Returns the length the full output would have.
+int
+snprintf(char *buf, int size, const char *fmt, ...)
+{
+  struct sink o = { 0, buf, size, 0 };
+  va_list ap;
+
+  va_start(ap, fmt);
+  format(&o, fmt, ap);
+  va_end(ap);
+
+  if(size > 0)
+    buf[o.n < size ? o.n : size - 1] = '\0';
+  return o.n;
 }
@@ -0,0 +1,74 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+// Run the kernel's sampling profiler for a while and print
+// every sample, one per line:
+//   S cpu pid name nkernel pc0 pc1 ...
+// pc0 is the innermost frame; the first nkernel pcs are
+// kernel addresses, the rest user addresses in process name.
+// Feed the output (e.g. the qemu console log) to the
+// profsym script to get folded stacks for a flame graph.
+// usage: prof [-m samples-per-tick] [seconds]
+
+#define NBUF 64
+
+static struct profsample buf[NBUF];
+
+static void
+drain(void)
+{
+  int i, j, n;
+
+  while((n = profread(buf, NBUF)) > 0){
+    for(i = 0; i < n; i++){
+      printf("S %d %d %s %d", buf[i].cpu, buf[i].pid,
+             buf[i].name[0] ? buf[i].name : "-", buf[i].nkernel);
+      for(j = 0; j < buf[i].depth; j++)
+        printf(" %p", buf[i].pc[j]);
+      printf("\n");
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mult = 1, secs = 10, dropped;
+  int end;
+
+  if(argc > 2 && strcmp(argv[1], "-m") == 0){
+    mult = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(mult < 1 || secs < 1){
+    fprintf(2, "usage: prof [-m samples-per-tick] [seconds]\n");
+    exit(1);
+  }
+
+  // throw away anything left from an earlier run.
+  profctl(0);
+  while(profread(buf, NBUF) > 0)
+    ;
+
+  if(profctl(mult) < 0){
+    fprintf(2, "prof: bad rate %d\n", mult);
+    exit(1);
+  }
+  // about 10 clock ticks per second under qemu.
+  end = uptime() + secs * 10;
+  while(uptime() < end){
+    sleep(1);
+    drain();
+  }
+  dropped = profctl(0);
+  drain();
+  fflush(1);
+  if(dropped > 0)
+    fprintf(2, "prof: %d samples dropped\n", dropped);
+  exit(0);
+}
@@ -0,0 +1,110 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/sync.h"
+
+// Tests for shmget()/shmat()/shmdt() and the ring in sync.c.
+
+#define KEY 0x5348
+#define SIZE (64*1024)
+#define NMSG 5000
+
+static void
+fail(char *msg)
+{
+  printf("shmtest: %s\n", msg);
+  exit(1);
+}
+
+static void
+segments(void)
+{
+  int id, pid;
+  char *p, *q;
+
+  if((id = shmget(KEY, SIZE)) < 0)
+    fail("shmget failed");
+  if(shmget(KEY, SIZE) != id)
+    fail("shmget of the same key gave a different id");
+  if(shmget(KEY, 2*SIZE) != -1)
+    fail("shmget grew an existing segment");
+  if((p = shmat(id)) == (char*)-1)
+    fail("shmat failed");
+  if(p[0] != 0 || p[SIZE-1] != 0)
+    fail("new segment not zeroed");
+
+  // a second attachment maps the same pages.
+  if((q = shmat(id)) == (char*)-1 || q == p)
+    fail("second shmat failed");
+  p[100] = 'a';
+  if(q[100] != 'a')
+    fail("attachments do not share pages");
+  shmdt(q);
+
+  // so does another process that attaches by key.
+  if((pid = fork()) == 0){
+    shmdt(p);  // inherited from the parent
+    if((q = shmat(shmget(KEY, SIZE))) == (char*)-1)
+      fail("child shmat failed");
+    if(q[100] != 'a')
+      fail("child does not see parent's write");
+    q[200] = 'b';
+    exit(0);
+  }
+  wait(0);
+  if(p[200] != 'b')
+    fail("parent does not see child's write");
+
+  // the last detach frees the segment; the key then makes a new one.
+  if(shmdt(p) < 0 || shmdt(p) != -1)
+    fail("shmdt");
+  if((id = shmget(KEY, SIZE)) < 0 || (p = shmat(id)) == (char*)-1)
+    fail("shmget after free");
+  if(p[100] != 0)
+    fail("segment not freed by last detach");
+  shmdt(p);
+}
+
+static void
+rings(void)
+{
+  struct ring *r;
+  char buf[64];
+  int id, pid, n, i;
+
+  if((id = shmget(0, SIZE)) < 0 || (r = shmat(id)) == (void*)-1)
+    fail("shmget for ring failed");
+  r = ring_init(r, SIZE);
+  if(ring_recv(r, buf, sizeof(buf), -1) != -1)
+    fail("ring_recv on an empty ring");
+
+  if((pid = fork()) == 0){
+    for(i = 0; i < NMSG; i++){
+      n = snprintf(buf, sizeof(buf), "message %d", i);
+      while(ring_send(r, buf, n) < 0)
+        sleep(1);  // full; let the reader catch up
+    }
+    exit(0);
+  }
+
+  for(i = 0; i < NMSG; i++){
+    char want[64];
+    int m = snprintf(want, sizeof(want), "message %d", i);
+
+    if((n = ring_recv(r, buf, sizeof(buf), 0)) != m || memcmp(buf, want, m) != 0)
+      fail("ring message lost or out of order");
+  }
+  wait(0);
+  if(ring_recv(r, buf, sizeof(buf), 2) != -1)
+    fail("ring_recv should time out");
+  shmdt(r);
+}
+
+int
+main(int argc, char *argv[])
+{
+  segments();
+  rings();
+  printf("shmtest: ok\n");
+  exit(0);
+}
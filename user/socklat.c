@@ -0,0 +1,111 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/socklat.h"
+#include "user/user.h"
+
+// Print latency percentiles for each stage of the socket
+// path, summed over all open sockets, then per socket.
+// usage: socklat [-s]
+//   -s  also print each socket separately
+
+static char *stages[NLATSTAGE] = {
+[LAT_LWIPRX] "lwip-rx",
+[LAT_WAKEUP] "wakeup",
+[LAT_RING]   "ring",
+[LAT_APP]    "app",
+[LAT_TX]     "tx",
+[LAT_ACK]    "ack",
+};
+
+static struct socklat sl[NSOCK];
+
+// upper bound of bucket b, in microseconds (10 mtime ticks each).
+static void
+printbound(int b)
+{
+  uint64 ticks = b == 0 ? 0 : (1L << b) - 1;
+
+  if(ticks < 10)
+    printf("<1");
+  else
+    printf("%l", ticks / 10);
+}
+
+// Print the bucket holding the pct'th percentile of count[].
+static void
+percentile(uint32 *count, uint64 total, int pct)
+{
+  uint64 want = (total * pct + 99) / 100, sum = 0;
+  int b;
+
+  for(b = 0; b < NLATBUCKET - 1; b++){
+    sum += count[b];
+    if(sum >= want)
+      break;
+  }
+  printf("\t");
+  printbound(b);
+}
+
+static void
+report(struct lathist *h)
+{
+  uint64 total;
+  int s, b, max;
+
+  printf("stage\tcount\tp50\tp90\tp99\tmax (us)\n");
+  for(s = 0; s < NLATSTAGE; s++){
+    total = 0;
+    max = 0;
+    for(b = 0; b < NLATBUCKET; b++){
+      total += h->n[s][b];
+      if(h->n[s][b])
+        max = b;
+    }
+    printf("%s\t%l", stages[s], total);
+    if(total == 0){
+      printf("\n");
+      continue;
+    }
+    percentile(h->n[s], total, 50);
+    percentile(h->n[s], total, 90);
+    percentile(h->n[s], total, 99);
+    printf("\t");
+    printbound(max);
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lathist sum;
+  int i, s, b, n, each = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-s") == 0)
+    each = 1;
+  else if(argc > 1){
+    fprintf(2, "usage: socklat [-s]\n");
+    exit(1);
+  }
+
+  if((n = socklat(sl, NSOCK)) < 0){
+    fprintf(2, "socklat: failed\n");
+    exit(1);
+  }
+
+  memset(&sum, 0, sizeof(sum));
+  for(i = 0; i < n; i++)
+    for(s = 0; s < NLATSTAGE; s++)
+      for(b = 0; b < NLATBUCKET; b++)
+        sum.n[s][b] += sl[i].h.n[s][b];
+  printf("all %d sockets:\n", n);
+  report(&sum);
+
+  for(i = 0; each && i < n; i++){
+    printf("\npid %d fd %d:\n", sl[i].pid, sl[i].fd);
+    report(&sl[i].h);
+  }
+  exit(0);
+}
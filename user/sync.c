@@ -0,0 +1,218 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/sync.h"
+
+// Mutex after Drepper, "Futexes Are Tricky": unlock only
+// calls futex_wake() if someone may be sleeping.
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c = 0;
+
+  if(__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex_wait(&m->state, 2, 0);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+// Returns 1 if it took the lock, 0 if it is held.
+int
+mutex_trylock(struct mutex *m)
+{
+  int c = 0;
+
+  return __atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2)
+    futex_wake(&m->state, 1);
+}
+
+// Wait for a signal, for at most ticks ticks if ticks > 0.
+// Returns 1 on timeout, else 0; wakeups may be spurious.
+int
+cond_timedwait(struct cond *c, struct mutex *m, int ticks)
+{
+  int seq, r;
+
+  seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+  mutex_unlock(m);
+  r = futex_wait(&c->seq, seq, ticks);
+
+  // others may be waiting for m too, so take it as contended.
+  while(__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) != 0)
+    futex_wait(&m->state, 2, 0);
+  return r == 1;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  cond_timedwait(c, m, 0);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Producers push onto a lock-free stack; the consumer takes
+// the whole stack at once and reverses it into FIFO order.
+
+void
+mpsc_push(struct mpsc *q, struct mpscnode *n)
+{
+  struct mpscnode *old = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+  do {
+    n->next = old;
+  } while(!__atomic_compare_exchange_n(&q->head, &old, n, 1,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  // ordered after the push, so a consumer that set waiting
+  // and then found the queue empty is sure to be woken.
+  if(__atomic_exchange_n(&q->waiting, 0, __ATOMIC_SEQ_CST))
+    futex_wake(&q->waiting, 1);
+}
+
+static int
+refill(struct mpsc *q)
+{
+  struct mpscnode *n, *next, *batch = 0;
+
+  n = __atomic_exchange_n(&q->head, 0, __ATOMIC_SEQ_CST);
+  for(; n; n = next){
+    next = n->next;
+    n->next = batch;
+    batch = n;
+  }
+  q->batch = batch;
+  return batch != 0;
+}
+
+// Take the oldest item. If the queue is empty, return 0 if
+// timeout < 0, else wait for a push, for at most timeout
+// ticks if timeout > 0.
+struct mpscnode*
+mpsc_pop(struct mpsc *q, int timeout)
+{
+  struct mpscnode *n;
+
+  while(q->batch == 0 && !refill(q)){
+    if(timeout < 0)
+      return 0;
+    __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+    if(refill(q)){
+      __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+      break;
+    }
+    if(futex_wait(&q->waiting, 1, timeout) == 1){
+      __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+      timeout = -1;  // one last look
+    }
+  }
+  n = q->batch;
+  q->batch = n->next;
+  return n;
+}
+
+// Set up a ring in bytes bytes of memory at mem; the data
+// area is the largest power of two that fits.
+struct ring*
+ring_init(void *mem, int bytes)
+{
+  struct ring *r = mem;
+  uint size;
+
+  if(bytes < sizeof(*r) + 8)
+    return 0;
+  for(size = 8; size * 2 <= bytes - sizeof(*r); size *= 2)
+    ;
+  r->head = r->tail = 0;
+  r->size = size;
+  r->waiting = 0;
+  return r;
+}
+
+// copy n bytes into or out of the ring at offset off, wrapping.
+static void
+ringcopy(struct ring *r, uint off, void *p, int n, int in)
+{
+  uint i = off & (r->size - 1);
+  int m = r->size - i < n ? r->size - i : n;
+
+  if(in){
+    memmove(r->data + i, p, m);
+    memmove(r->data, (char*)p + m, n - m);
+  } else {
+    memmove(p, r->data + i, m);
+    memmove((char*)p + m, r->data, n - m);
+  }
+}
+
+// Append a message. Never blocks: returns -1 if the ring
+// does not have room for it, else 0.
+int
+ring_send(struct ring *r, const void *msg, int n)
+{
+  uint head = r->head;
+  uint tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+  if(n < 0 || r->size - (head - tail) < sizeof(uint) + n)
+    return -1;
+  ringcopy(r, head, &n, sizeof(uint), 1);
+  ringcopy(r, head + sizeof(uint), (void*)msg, n, 1);
+  __atomic_store_n(&r->head, head + sizeof(uint) + n, __ATOMIC_SEQ_CST);
+
+  if(__atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST))
+    futex_wake(&r->waiting, 1);
+  return 0;
+}
+
+// Take the oldest message and copy at most max bytes of it
+// into buf; the rest of a longer message is dropped. Returns
+// the number of bytes copied, or -1 if there is no message.
+// Waits like mpsc_pop() if the ring is empty.
+int
+ring_recv(struct ring *r, void *buf, int max, int timeout)
+{
+  uint tail = r->tail;
+  int n;
+
+  while(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail){
+    if(timeout < 0)
+      return -1;
+    __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) != tail){
+      __atomic_store_n(&r->waiting, 0, __ATOMIC_RELAXED);
+      break;
+    }
+    if(futex_wait(&r->waiting, 1, timeout) == 1){
+      __atomic_store_n(&r->waiting, 0, __ATOMIC_RELAXED);
+      timeout = -1;  // one last look
+    }
+  }
+  ringcopy(r, tail, &n, sizeof(uint), 0);
+  ringcopy(r, tail + sizeof(uint), buf, n < max ? n : max, 0);
+  __atomic_store_n(&r->tail, tail + sizeof(uint) + n, __ATOMIC_RELEASE);
+  return n < max ? n : max;
+}
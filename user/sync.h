@@ -0,0 +1,55 @@
+// Synchronization for threads (see clone()) and for
+// processes sharing memory, built on futex_wait() and
+// futex_wake(). Uncontended operations make no system calls.
+// All of these may be zero-initialized.
+
+// Mutual exclusion lock.
+struct mutex {
+  volatile int state;   // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+// Condition variable, used with a mutex.
+struct cond {
+  volatile int seq;     // bumped by every signal and broadcast
+};
+
+// Intrusive multi-producer, single-consumer queue: any thread
+// may mpsc_push(), only one may mpsc_pop(). Embed a struct
+// mpscnode in each item.
+struct mpscnode {
+  struct mpscnode *next;
+};
+
+struct mpsc {
+  struct mpscnode *volatile head;   // pushed items, newest first
+  struct mpscnode *batch;           // consumer's items, oldest first
+  volatile int waiting;             // consumer is in futex_wait()
+};
+
+// Single-producer, single-consumer message ring, laid out in
+// one block of memory so that it can live in a shared-memory
+// segment (see shmat()) between two processes. Each message
+// is a 4-byte length followed by its bytes.
+struct ring {
+  volatile uint head;   // bytes ever written, by the producer
+  volatile uint tail;   // bytes ever read, by the consumer
+  uint size;            // bytes in data[], a power of two
+  volatile int waiting; // consumer is in futex_wait()
+  char data[];
+};
+
+void mutex_lock(struct mutex*);
+int  mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+
+void cond_wait(struct cond*, struct mutex*);
+int  cond_timedwait(struct cond*, struct mutex*, int ticks);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+void mpsc_push(struct mpsc*, struct mpscnode*);
+struct mpscnode* mpsc_pop(struct mpsc*, int timeout);
+
+struct ring* ring_init(void *mem, int bytes);
+int  ring_send(struct ring*, const void *msg, int n);
+int  ring_recv(struct ring*, void *buf, int max, int timeout);
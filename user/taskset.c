@@ -0,0 +1,47 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Run a command, or change a running process, pinned to a
+// set of CPUs given as a bit mask (bit i = CPU i).
+// usage: taskset mask command [args...]
+//        taskset -p mask pid
+//        taskset -p pid             (print the mask)
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: taskset mask command [args...]\n"
+             "       taskset -p [mask] pid\n");
+  exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  int old;
+
+  if(argc < 3)
+    usage();
+
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc == 3)
+      old = setaffinity(atoi(argv[2]), 0);
+    else
+      old = setaffinity(atoi(argv[3]), atoi(argv[2]));
+    if(old < 0){
+      fprintf(2, "taskset: failed\n");
+      exit(1);
+    }
+    printf("pid %s: mask was %d\n", argv[argc-1], old);
+    exit(0);
+  }
+
+  if(atoi(argv[1]) == 0 || setaffinity(0, atoi(argv[1])) < 0){
+    fprintf(2, "taskset: bad mask %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
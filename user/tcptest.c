@@ -0,0 +1,132 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "kernel/netstat.h"
+#include "user/user.h"
+
+// Bulk TCP transfer over the loopback interface. The sender writes
+// a counting pattern in large chunks; the receiver starts late, so
+// the socket ring fills and data is held back, then reads in odd
+// sizes and checks every byte.
+//
+// "tcptest -l" instead receives the same pattern from tcpsend.py on
+// the host, through the NIC, and counts the frames that arrived as
+// a chain of pbufs. With -j it fails unless there were some, which
+// needs jumbo frames: "make TAP=tap0" and a host tap with MTU 9000.
+
+#define PORT 5002
+#define HOSTPORT 5001   // IPERFPORT in the Makefile
+#define NBULK (1024*1024)
+
+static char buf[8192];
+static struct netstat ns;
+static int rsizes[] = { 1, 7, 100, 511, 1024, 1500, 4096, 8192 };
+#define NRSIZE (sizeof(rsizes)/sizeof(rsizes[0]))
+
+static void
+fail(char *msg)
+{
+  fprintf(2, "tcptest: %s\n", msg);
+  exit(1);
+}
+
+// Read from conn until EOF, checking the pattern; returns the bytes read.
+static int
+check(int conn)
+{
+  int n, r, k;
+
+  k = 0;
+  for(n = 0; (r = read(conn, buf, rsizes[k++ % NRSIZE])) > 0; n += r)
+    for(int i = 0; i < r; i++)
+      if(buf[i] != (char)((n + i) % 251))
+        fail("data corrupted");
+  if(r < 0)
+    fail("read failed");
+  return n;
+}
+
+static void
+fromhost(int jumbo)
+{
+  struct sockaddr addr, peer;
+  int srv, conn, n, peerlen;
+  uint64 chain;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sa_family = AF_INET;
+  addr.sin_port = HOSTPORT;
+  if((srv = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+     bind(srv, &addr, sizeof(addr)) < 0 || listen(srv, 1) < 0)
+    fail("listen failed");
+  printf("tcptest: waiting on port %d\n", HOSTPORT);
+  if((conn = accept(srv, &peer, &peerlen)) < 0)
+    fail("accept failed");
+  if(netstat(&ns) < 0)
+    fail("netstat failed");
+  chain = ns.rx_chain;
+  n = check(conn);
+  if(netstat(&ns) < 0)
+    fail("netstat failed");
+  chain = ns.rx_chain - chain;
+  printf("tcptest: %d bytes, %l frames over several buffers\n", n, chain);
+  if(jumbo && chain == 0)
+    fail("no frame spanned several buffers");
+  close(conn);
+  close(srv);
+}
+
+static void
+bulk(void)
+{
+  struct sockaddr addr, peer;
+  int srv, conn, n, peerlen;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sa_family = AF_INET;
+  addr.sin_port = PORT;  // bind() takes the port in host order
+  inetaddress("127.0.0.1", &addr);
+  if((srv = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+     bind(srv, &addr, sizeof(addr)) < 0 || listen(srv, 1) < 0)
+    fail("listen failed");
+  addr.sin_port = htons(PORT);
+
+  if(fork() == 0){
+    close(srv);
+    if((conn = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+       connect(conn, &addr, sizeof(addr)) < 0)
+      fail("connect failed");
+    for(n = 0; n < NBULK; n += sizeof(buf)){
+      for(int i = 0; i < sizeof(buf); i++)
+        buf[i] = (n + i) % 251;
+      if(write(conn, buf, sizeof(buf)) != sizeof(buf))
+        fail("write failed");
+    }
+    close(conn);
+    exit(0);
+  }
+
+  if((conn = accept(srv, &peer, &peerlen)) < 0)
+    fail("accept failed");
+  sleep(10);
+  if((n = check(conn)) != NBULK){
+    printf("tcptest: %d of %d bytes\n", n, NBULK);
+    fail("short transfer");
+  }
+  wait(0);
+  close(conn);
+  close(srv);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-l") == 0)
+    fromhost(argc > 2 && strcmp(argv[2], "-j") == 0);
+  else
+    bulk();
+  printf("tcptest: ok\n");
+  exit(0);
+}
@@ -0,0 +1,166 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+
+// Tests for UDP sockets over the loopback interface: sendto()
+// and recvfrom(), connected read()/write(), net_poll(), and
+// the per-socket datagram queue.
+
+#define PORT 5002
+#define NMSG 100
+
+static char big[MAXDGRAM];
+
+static void
+fail(char *msg)
+{
+  printf("udptest: %s\n", msg);
+  exit(1);
+}
+
+static int
+udpsock(int port)
+{
+  struct sockaddr addr;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sa_family = AF_INET;
+  addr.sin_port = port;  // bind() takes the port in host order
+  inetaddress("127.0.0.1", &addr);
+  if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    fail("socket failed");
+  if(bind(fd, &addr, sizeof(addr)) < 0)
+    fail("bind failed");
+  return fd;
+}
+
+static void
+datagrams(void)
+{
+  struct sockaddr to, from;
+  char buf[64];
+  int srv, cli, fromlen, n;
+
+  srv = udpsock(PORT);
+  cli = udpsock(PORT + 1);
+  memset(&to, 0, sizeof(to));
+  to.sa_family = AF_INET;
+  to.sin_port = htons(PORT);
+  inetaddress("127.0.0.1", &to);
+
+  // one datagram at a time, boundaries kept.
+  for(int i = 0; i < NMSG; i++){
+    n = 1 + i % 40;
+    memset(buf, 'a' + i % 26, n);
+    if(sendto(cli, buf, n, &to, sizeof(to)) != n)
+      fail("sendto failed");
+    memset(buf, 0, sizeof(buf));
+    if(recvfrom(srv, buf, sizeof(buf), &from, &fromlen) != n)
+      fail("recvfrom returned the wrong length");
+    if(buf[0] != 'a' + i % 26 || buf[n-1] != 'a' + i % 26)
+      fail("datagram corrupted");
+    if(from.sin_port != htons(PORT + 1))
+      fail("wrong source port");
+  }
+
+  // reply to the source, and truncate a long datagram.
+  if(sendto(srv, "pong!", 5, &from, sizeof(from)) != 5)
+    fail("reply failed");
+  if(recvfrom(cli, buf, 4, 0, 0) != 4 || memcmp(buf, "pong", 4) != 0)
+    fail("truncated recvfrom");
+
+  // the largest datagram one packet holds, MAXDGRAM with the MTU.
+  for(int i = 0; i < MAXDGRAM; i++)
+    big[i] = i % 251;
+  if(sendto(cli, big, MAXDGRAM, &to, sizeof(to)) != MAXDGRAM)
+    fail("sendto of a full-size datagram failed");
+  memset(big, 0, sizeof(big));
+  if(recvfrom(srv, big, sizeof(big), 0, 0) != MAXDGRAM)
+    fail("full-size datagram has the wrong length");
+  for(int i = 0; i < MAXDGRAM; i++)
+    if(big[i] != (char)(i % 251))
+      fail("full-size datagram corrupted");
+
+  // too large for one packet.
+  if(sendto(cli, big, MAXDGRAM + 1, &to, sizeof(to)) != -1)
+    fail("sent an oversized datagram");
+
+  close(srv);
+  close(cli);
+}
+
+static void
+connected(void)
+{
+  struct sockaddr peer;
+  char buf[16];
+  int a, b;
+
+  a = udpsock(PORT);
+  b = udpsock(PORT + 1);
+  memset(&peer, 0, sizeof(peer));
+  peer.sa_family = AF_INET;
+  peer.sin_port = htons(PORT + 1);
+  inetaddress("127.0.0.1", &peer);
+  if(connect(a, &peer, sizeof(peer)) < 0)
+    fail("connect failed");
+  if(write(a, "hello", 5) != 5)
+    fail("write on a connected socket failed");
+  if(read(b, buf, sizeof(buf)) != 5 || memcmp(buf, "hello", 5) != 0)
+    fail("read of a datagram failed");
+  close(a);
+  close(b);
+}
+
+static void
+polling(void)
+{
+  struct sockaddr to;
+  struct pollfd pfd;
+  char buf[8];
+  int s, n;
+
+  s = udpsock(PORT);
+  memset(&to, 0, sizeof(to));
+  to.sa_family = AF_INET;
+  to.sin_port = htons(PORT);
+  inetaddress("127.0.0.1", &to);
+
+  pfd.fd = s;
+  pfd.events = POLLIN;
+  if(net_poll(&pfd, 1, 0) != 0)
+    fail("empty socket polled readable");
+  fcntl(s, F_SETFL, O_NONBLOCK);
+  if(recvfrom(s, buf, sizeof(buf), 0, 0) != -1)
+    fail("non-blocking recvfrom on an empty queue");
+
+  // the queue holds NDGRAM datagrams; later ones are dropped.
+  // lwIP has few packet buffers, so let each one arrive first.
+  for(int i = 0; i < 2 * NDGRAM; i++){
+    if(sendto(s, &i, sizeof(i), &to, sizeof(to)) != sizeof(i))
+      fail("sendto to self failed");
+    sleep(1);
+  }
+  if(net_poll(&pfd, 1, 10) != 1 || !(pfd.revents & POLLIN))
+    fail("net_poll missed a datagram");
+  for(n = 0; recvfrom(s, buf, sizeof(buf), 0, 0) == sizeof(int); n++)
+    if(*(int*)buf != n)
+      fail("datagrams out of order");
+  if(n != NDGRAM)
+    fail("datagram queue did not hold NDGRAM");
+  close(s);
+}
+
+int
+main(int argc, char *argv[])
+{
+  datagrams();
+  connected();
+  polling();
+  printf("udptest: ok\n");
+  exit(0);
+}
@@ -3,6 +3,71 @@
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
+// Word-sized access that may alias any other type.
+typedef uint64 __attribute__((may_alias)) word;
+
+#define WSIZE     sizeof(word)
+#define WMASK     (WSIZE - 1)
+#define ALIGNED(p) (((uint64)(p) & WMASK) == 0)
+
+// Set by printf.c while stdout holds buffered output, so that
+// fork() doesn't duplicate it and exit() and exec() don't lose it.
+void (*stdio_flush)(void);
+
+int
+fork(void)
+{
+  if(stdio_flush)
+    stdio_flush();
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdio_flush)
+    stdio_flush();
+  _exit(status);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(stdio_flush)
+    stdio_flush();
+  return _exec(path, argv);
+}
+
+// Where a new thread finds its start routine; kept at the
+// top of its stack.
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+tstart(void *a)
+{
+  struct tstart *t = a;
+
+  t->fn(t->arg);
+  exit(0);
+}
+
+// Run fn(arg) in a new thread on the given stack, which must
+// stay allocated until the thread has been wait()ed for.
+// The thread exits when fn returns. Returns its pid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg, void *stack, int size)
+{
+  struct tstart *t;
+
+  t = (struct tstart*)(((uint64)stack + size - sizeof(*t)) & ~15);
+  t->fn = fn;
+  t->arg = arg;
+  return clone(tstart, t, t);
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -36,10 +101,28 @@ void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  word v, *w;
+
+  while(n > 0 && !ALIGNED(cdst)){
+    *cdst++ = c;
+    n--;
   }
+
+  v = (uchar)c;
+  v |= v << 8;
+  v |= v << 16;
+  v |= v << 32;
+  w = (word *)cdst;
+  for(; n >= 8*WSIZE; n -= 8*WSIZE, w += 8){
+    w[0] = v; w[1] = v; w[2] = v; w[3] = v;
+    w[4] = v; w[5] = v; w[6] = v; w[7] = v;
+  }
+  for(; n >= WSIZE; n -= WSIZE)
+    *w++ = v;
+
+  cdst = (char *)w;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -58,6 +141,10 @@ gets(char *buf, int max)
   int i, cc;
   char c;
 
+  // show any pending prompt before blocking for input.
+  if(stdio_flush)
+    stdio_flush();
+
   for(i=0; i+1 < max; ){
     cc = read(0, &c, 1);
     if(cc < 1)
@@ -95,37 +182,103 @@ atoi(const char *s)
   return n;
 }
 
+// Forward copy of n bytes to a word-aligned d.
+// If s is not aligned too, read aligned words and shift them
+// into place; the extra bytes read always lie in the same
+// aligned word as a byte we need, so never on another page.
+static void
+copyfwd(char *d, const char *s, uint n)
+{
+  word *wd = (word *)d;
+
+  if(ALIGNED(s)){
+    const word *ws = (const word *)s;
+    for(; n >= 8*WSIZE; n -= 8*WSIZE, wd += 8, ws += 8){
+      word a = ws[0], b = ws[1], c = ws[2], e = ws[3];
+      word f = ws[4], g = ws[5], h = ws[6], i = ws[7];
+      wd[0] = a; wd[1] = b; wd[2] = c; wd[3] = e;
+      wd[4] = f; wd[5] = g; wd[6] = h; wd[7] = i;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = *ws++;
+    s = (const char *)ws;
+  } else if(n >= WSIZE){
+    int sh = ((uint64)s & WMASK) * 8;
+    const word *ws = (const word *)((uint64)s & ~WMASK);
+    word lo = *ws++, hi;
+    for(; n >= WSIZE; n -= WSIZE, s += WSIZE){
+      hi = *ws++;
+      *wd++ = (lo >> sh) | (hi << (64 - sh));  // little-endian
+      lo = hi;
+    }
+  }
+
+  d = (char *)wd;
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
 void*
-memmove(void *vdst, const void *vsrc, int n)
+memmove(void *dst, const void *src, int n)
 {
-  char *dst;
-  const char *src;
+  const char *s;
+  char *d;
 
-  dst = vdst;
-  src = vsrc;
-  if (src > dst) {
+  if(n <= 0)
+    return dst;
+  
+  s = src;
+  d = dst;
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    if(((uint64)s & WMASK) == ((uint64)d & WMASK)){
+      while(n > 0 && !ALIGNED(d)){
+        *--d = *--s;
+        n--;
+      }
+      for(; n >= WSIZE; n -= WSIZE){
+        d -= WSIZE;
+        s -= WSIZE;
+        *(word *)d = *(word *)s;
+      }
+    }
     while(n-- > 0)
-      *dst++ = *src++;
+      *--d = *--s;
   } else {
-    dst += n;
-    src += n;
-    while(n-- > 0)
-      *--dst = *--src;
+    while(n > 0 && !ALIGNED(d)){
+      *d++ = *s++;
+      n--;
+    }
+    copyfwd(d, s, n);
   }
-  return vdst;
+
+  return dst;
 }
 
 int
-memcmp(const void *s1, const void *s2, uint n)
+memcmp(const void *v1, const void *v2, uint n)
 {
-  const char *p1 = s1, *p2 = s2;
-  while (n-- > 0) {
-    if (*p1 != *p2) {
-      return *p1 - *p2;
+  const uchar *s1, *s2;
+
+  s1 = v1;
+  s2 = v2;
+  if(((uint64)s1 & WMASK) == ((uint64)s2 & WMASK)){
+    while(n > 0 && !ALIGNED(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
     }
-    p1++;
-    p2++;
+    // skip equal words; the byte loop below finds the difference.
+    while(n >= WSIZE && *(word *)s1 == *(word *)s2)
+      s1 += WSIZE, s2 += WSIZE, n -= WSIZE;
   }
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+
   return 0;
 }
 
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "user/sync.h"
 #include "kernel/param.h"
 
 // Memory allocator by Kernighan and Ritchie,
@@ -20,9 +21,10 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static struct mutex lock;   // threads share the heap
 
-void
-free(void *ap)
+static void
+freeblock(void *ap)
 {
   Header *bp, *p;
 
@@ -56,10 +58,18 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  freeblock((void*)(hp + 1));
   return freep;
 }
 
+void
+free(void *ap)
+{
+  mutex_lock(&lock);
+  freeblock(ap);
+  mutex_unlock(&lock);
+}
+
 void*
 malloc(uint nbytes)
 {
@@ -67,6 +77,7 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  mutex_lock(&lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +92,13 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      mutex_unlock(&lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        mutex_unlock(&lock);
         return 0;
+      }
   }
 }
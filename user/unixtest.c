@@ -0,0 +1,128 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/socklat.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+
+// Tests for AF_UNIX stream sockets: naming, connect/accept,
+// read/write round trips, net_poll(), non-blocking reads and
+// end of file.
+
+#define NROUND 1000
+
+static void
+fail(char *msg)
+{
+  printf("unixtest: %s\n", msg);
+  exit(1);
+}
+
+static void
+name(struct sockaddr_un *a, char *path)
+{
+  memset(a, 0, sizeof(*a));
+  a->sun_family = AF_UNIX;
+  strcpy(a->sun_path, path);
+}
+
+static void
+client(void)
+{
+  struct sockaddr_un a;
+  char c;
+  int s;
+
+  name(&a, "unixtest");
+  if((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    fail("client socket failed");
+  if(connect(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+    fail("connect failed");
+  for(int i = 0; i < NROUND; i++){
+    c = i;
+    if(write(s, &c, 1) != 1 || read(s, &c, 1) != 1 || c != (char)(i + 1))
+      fail("round trip failed");
+  }
+  close(s);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sockaddr_un a;
+  struct sockaddr peer;
+  struct pollfd pfd;
+  int l, s, peerlen, start;
+  char c;
+
+  name(&a, "unixtest");
+  if((l = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    fail("socket failed");
+  if(bind(l, (struct sockaddr*)&a, sizeof(a)) < 0 || listen(l, 1) < 0)
+    fail("bind/listen failed");
+
+  if((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    fail("socket failed");
+  if(bind(s, (struct sockaddr*)&a, sizeof(a)) != -1)
+    fail("bound a name twice");
+  name(&a, "nosuch");
+  if(connect(s, (struct sockaddr*)&a, sizeof(a)) != -1)
+    fail("connected to a missing name");
+  close(s);
+
+  start = uptime();
+  if(fork() == 0)
+    client();
+
+  pfd.fd = l;
+  pfd.events = POLLIN;
+  if(net_poll(&pfd, 1, 100) != 1 || !(pfd.revents & POLLIN))
+    fail("no pending connection from net_poll");
+  if((s = accept(l, &peer, &peerlen)) < 0 || peer.sa_family != AF_UNIX)
+    fail("accept failed");
+
+  // echo each byte back, plus one.
+  pfd.fd = s;
+  for(int i = 0; i < NROUND; i++){
+    if(net_poll(&pfd, 1, 100) != 1 || !(pfd.revents & POLLIN))
+      fail("net_poll missed data");
+    if(read(s, &c, 1) != 1 || c != (char)i)
+      fail("read the wrong byte");
+    c++;
+    if(write(s, &c, 1) != 1)
+      fail("write failed");
+  }
+  wait(0);
+  printf("unixtest: %d round trips in %d ticks\n", NROUND, uptime() - start);
+
+  // the client has closed: end of file, and a hang-up.
+  if(net_poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLHUP))
+    fail("no POLLHUP after close");
+  if(read(s, &c, 1) != 0)
+    fail("no end of file after close");
+  if(write(s, &c, 1) != -1)
+    fail("wrote to a closed peer");
+  close(s);
+
+  // a non-blocking read of an empty socket fails at once.
+  if(fork() == 0){
+    name(&a, "unixtest");
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connect(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+      fail("connect failed");
+    read(s, &c, 1);  // until the parent closes
+    exit(0);
+  }
+  if((s = accept(l, &peer, &peerlen)) < 0)
+    fail("accept failed");
+  fcntl(s, F_SETFL, O_NONBLOCK);
+  if(read(s, &c, 1) != -1)
+    fail("non-blocking read did not fail");
+  close(s);
+  wait(0);
+  close(l);
+
+  printf("unixtest: ok\n");
+  exit(0);
+}
@@ -2,6 +2,11 @@ struct stat;
 struct rtcdate;
 struct sockaddr;
 struct pollfd;
+struct lockstat;
+struct profsample;
+struct netstat;
+struct socklat;
+struct iperfreport;
 
 // Poll event flags (same as kernel/socket.h)
 #define POLLIN      0x001   // Data available to read
@@ -14,19 +19,27 @@ struct pollfd;
 #define O_NONBLOCK  0x800
 #define F_GETFL     3
 #define F_SETFL     4
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
 #define EAGAIN      11
 #define EWOULDBLOCK EAGAIN
 
+// stdio buffering modes (printf.c)
+#define BUFSIZ      512
+#define _IOFBF      1   // fully buffered: files, pipes, sockets
+#define _IOLBF      2   // line buffered: the console
+#define _IONBF      3   // unbuffered: stderr
+
 // system calls
-int fork(void);
-int exit(int) __attribute__((noreturn));
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
 int read(int, void*, int);
 int close(int);
 int kill(int);
-int exec(char*, char**);
+int _exec(char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -51,15 +64,36 @@ int inetaddress(const char*, struct sockaddr*);
 uint timenow();
 int net_poll(struct pollfd*, int, int);
 int fcntl(int, int, ...);
+int setaffinity(int, uint);
+int lockstat(struct lockstat*, int, int);
+int profctl(int);
+int profread(struct profsample*, int);
+int netstat(struct netstat*);
+int socklat(struct socklat*, int);
+int clone(void (*)(void*), void*, void*);
+int futex_wait(volatile int*, int, int);
+int futex_wake(volatile int*, int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int splice(int, int, int);
+int sendto(int, const void*, int, const struct sockaddr*, int);
+int recvfrom(int, void*, int, struct sockaddr*, int*);
+int resolve(const char*);
+int dnsserver(uint32);
+int iperf(int, uint32, int, struct iperfreport*);
 
 // ulib.c
+extern void (*stdio_flush)(void);
+int fork(void);
+int exit(int) __attribute__((noreturn));
+int exec(char*, char**);
+int thread_create(void (*)(void*), void*, void*, int);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
-void fprintf(int, const char*, ...);
-void printf(const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
@@ -69,3 +103,9 @@ int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 uint16 htons(uint16 n);
+
+// printf.c
+void fprintf(int, const char*, ...);
+void printf(const char*, ...);
+void fflush(int);
+int snprintf(char*, int, const char*, ...);
@@ -6,24 +6,26 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry(name[, sys]): stub called name for system call SYS_sys.
 sub entry {
     my $name = shift;
+    my $sys = shift || $name;
     print ".global $name\n";
     print "${name}:\n";
-    print " li a7, SYS_${name}\n";
+    print " li a7, SYS_${sys}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("_fork", "fork");
+entry("_exit", "exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("_exec", "exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -47,4 +49,22 @@ entry("gethostbyname");
 entry("inetaddress");
 entry("timenow");
 entry("net_poll");
-entry("fcntl");
\ No newline at end of file
+entry("fcntl");
+entry("setaffinity");
+entry("lockstat");
+entry("profctl");
+entry("profread");
+entry("netstat");
+entry("socklat");
+entry("clone");
+entry("futex_wait");
+entry("futex_wake");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("splice");
+entry("sendto");
+entry("recvfrom");
+entry("resolve");
+entry("dnsserver");
+entry("iperf");
\ No newline at end of file
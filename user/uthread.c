@@ -10,9 +10,17 @@
 #define STACK_SIZE  8192
 #define MAX_THREAD  4
 
+/* Saved registers for thread_switch() in uthread_switch.S. */
+struct context {
+  uint64     ra;
+  uint64     sp;
+  uint64     s[12];             /* callee-saved s0-s11 */
+};
+
 struct thread {
   char       stack[STACK_SIZE]; /* the thread's stack */
   int        state;             /* FREE, RUNNING, RUNNABLE */
+  struct context context;       /* registers saved by thread_switch() */
 };
 struct thread all_thread[MAX_THREAD];
 struct thread *current_thread;
@@ -57,16 +65,13 @@ thread_schedule(void)
     next_thread->state = RUNNING;
     t = current_thread;
     current_thread = next_thread;
-    /* YOUR CODE HERE
-     * Invoke thread_switch to switch from t to next_thread:
-     * thread_switch(??, ??);
-     */
+    thread_switch((uint64)&t->context, (uint64)&next_thread->context);
   } else
     next_thread = 0;
 }
 
 void 
-thread_create(void (*func)())
+uthread_create(void (*func)())
 {
   struct thread *t;
 
@@ -74,7 +79,10 @@ thread_create(void (*func)())
     if (t->state == FREE) break;
   }
   t->state = RUNNABLE;
-  // YOUR CODE HERE
+  // start at func on the thread's own stack.
+  memset(&t->context, 0, sizeof(t->context));
+  t->context.ra = (uint64)func;
+  t->context.sp = (uint64)(t->stack + STACK_SIZE);
 }
 
 void 
@@ -153,9 +161,9 @@ main(int argc, char *argv[])
   a_started = b_started = c_started = 0;
   a_n = b_n = c_n = 0;
   thread_init();
-  thread_create(thread_a);
-  thread_create(thread_b);
-  thread_create(thread_c);
+  uthread_create(thread_a);
+  uthread_create(thread_b);
+  uthread_create(thread_c);
   thread_schedule();
   exit(0);
 }